@@ -0,0 +1,618 @@
+#include "batch.h"
+#include "command_stream.h"
+#include "dimensions.h"
+#include "frame_ring.h"
+#include "frame_sequence.h"
+#include "jpeg_transcoder.h"
+#include "tiled_decoder.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+static uint64_t file_size_or_zero(const std::string &path)
+{
+    std::error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    return ec ? 0 : size;
+}
+
+bool convert_file(ConvertWorker &worker, const ConvertJob &job, const PngOptions &png_options,
+                  OutputCache *cache)
+{
+    worker.width = job.width;
+    worker.height = job.height;
+    worker.macroblocks = 0;
+    worker.input_bytes = 0;
+    worker.cached = false;
+
+    bool read;
+    {
+        MDEC_STAGE_TIMER(worker.ctx.stats, MDEC_STAGE_READ);
+        TraceScope trace("read");
+        read = read_mdec_file(job.input.c_str(), worker.words);
+    }
+    if (!read)
+    {
+        std::cerr << "Error: Could not read input file " << job.input << std::endl;
+        return false;
+    }
+    return convert_words(worker, job, png_options, cache);
+}
+
+bool convert_words(ConvertWorker &worker, const ConvertJob &job, const PngOptions &png_options,
+                   OutputCache *cache)
+{
+    worker.width = job.width;
+    worker.height = job.height;
+    worker.macroblocks = 0;
+    worker.cached = false;
+    worker.input_bytes = worker.words.size() * sizeof(uint16_t);
+
+    worker.ctx.quant = job.quant;
+    MdecStats *stats = worker.ctx.stats;
+    MDEC_STATS_ADD(stats, files, 1);
+    MDEC_STATS_ADD(stats, bytes_in, worker.input_bytes);
+
+    if ((worker.width <= 0 || worker.height <= 0) &&
+        !infer_mdec_size(worker.words.data(), worker.words.data() + worker.words.size(), worker.width, worker.height))
+    {
+        std::cerr << "Error: Could not infer the size of " << job.input << std::endl;
+        return false;
+    }
+    int width = worker.width;
+    int height = worker.height;
+
+    uint64_t key = 0;
+    if (cache)
+    {
+        TraceScope trace("cache lookup");
+        key = cache->key(worker.words.data(), worker.words.size(), width, height, job.output, png_options,
+                         job.quant);
+        if (cache->fetch(key, job.output))
+        {
+            worker.cached = true;
+            return true;
+        }
+    }
+
+    uint16_t *data = worker.words.data();
+    if (image_format_from_path(job.output.c_str()) == IMAGE_FORMAT_JPEG)
+    {
+        // Coefficient-domain transcode, no pixels involved
+        std::vector<uint8_t> &jpeg = worker.image;
+        {
+            TraceScope trace("transcode");
+            worker.macroblocks = transcode_mdec_to_jpeg(worker.ctx, &data, data + worker.words.size(),
+                                                        width, height, jpeg);
+        }
+        bool written;
+        {
+            MDEC_STAGE_TIMER(stats, MDEC_STAGE_WRITE);
+            TraceScope trace("write");
+            written = write_bytes(job.output.c_str(), jpeg);
+        }
+        if (!written)
+        {
+            std::cerr << "Error: Could not write " << job.output << std::endl;
+            return false;
+        }
+        MDEC_STATS_ADD(stats, bytes_out, jpeg.size());
+        if (cache)
+            cache->store(key, job.output);
+        return true;
+    }
+
+    worker.image.assign((size_t)width * height * 3, 0);
+    {
+        TraceScope trace("decode");
+        worker.macroblocks = decode_mdec_frame(worker.ctx, &data, data + worker.words.size(),
+                                               width, height, worker.image.data());
+    }
+
+    bool written;
+    {
+        MDEC_STAGE_TIMER(stats, MDEC_STAGE_WRITE);
+        TraceScope trace("write");
+        written = write_image(job.output.c_str(), width, height, worker.image.data(), png_options);
+    }
+    if (!written)
+    {
+        std::cerr << "Error: Could not write " << job.output << std::endl;
+        return false;
+    }
+    MDEC_STATS_ADD(stats, bytes_out, file_size_or_zero(job.output));
+    if (cache)
+        cache->store(key, job.output);
+    return true;
+}
+
+static std::string frame_output_path(const std::string &pattern, size_t index)
+{
+    char buffer[4096];
+    if (pattern.find('%') != std::string::npos)
+    {
+        snprintf(buffer, sizeof(buffer), pattern.c_str(), (int)index);
+        return buffer;
+    }
+    fs::path path(pattern);
+    snprintf(buffer, sizeof(buffer), "_%04d", (int)index);
+    fs::path out = path.parent_path() / path.stem();
+    out += buffer;
+    out += path.extension();
+    return out.string();
+}
+
+void print_macroblock_stats(uint64_t lookups, uint64_t hits, uint64_t previous_frame_hits)
+{
+    printf("Macroblock cache: %llu/%llu hits (%.1f%%), %llu reused from the previous frame\n",
+           (unsigned long long)hits, (unsigned long long)lookups, lookups ? 100.0 * hits / lookups : 0.0,
+           (unsigned long long)previous_frame_hits);
+}
+
+bool convert_region(const ConvertJob &job, int x, int y, int width, int height, const PngOptions &png_options)
+{
+    std::vector<uint16_t> words;
+    if (!read_mdec_file(job.input.c_str(), words))
+    {
+        std::cerr << "Error: Could not read input file " << job.input << std::endl;
+        return false;
+    }
+    int image_width = job.width;
+    int image_height = job.height;
+    if (image_width == 0 &&
+        !infer_mdec_size(words.data(), words.data() + words.size(), image_width, image_height))
+    {
+        std::cerr << "Error: Could not infer the size of " << job.input << std::endl;
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    TiledDecoder decoder(words.data(), words.data() + words.size(), image_width, image_height);
+    decoder.context().quant = job.quant;
+    auto indexed = std::chrono::steady_clock::now();
+    width = std::min(width, image_width - x);
+    height = std::min(height, image_height - y);
+    std::vector<uint8_t> rgb(width > 0 && height > 0 ? (size_t)width * height * 3 : 0);
+    if (!decoder.read_region(x, y, width, height, rgb.data(), (size_t)width * 3))
+    {
+        std::cerr << "Error: Region lies outside the " << image_width << "x" << image_height << " image" << std::endl;
+        return false;
+    }
+    auto decoded = std::chrono::steady_clock::now();
+    if (!decoder.complete())
+        std::cerr << "Warning: " << job.input << " ends before " << image_width << "x" << image_height << std::endl;
+
+    if (!write_image(job.output.c_str(), width, height, rgb.data(), png_options))
+    {
+        std::cerr << "Error: Could not write " << job.output << std::endl;
+        return false;
+    }
+    printf("Decoded %llu of %d macroblocks for %dx%d at (%d, %d): index %.3f ms, decode %.3f ms\n",
+           (unsigned long long)decoder.macroblocks_decoded, ((image_width + 15) / 16) * ((image_height + 15) / 16),
+           width, height, x, y, std::chrono::duration<double, std::milli>(indexed - start).count(),
+           std::chrono::duration<double, std::milli>(decoded - indexed).count());
+    return true;
+}
+
+bool convert_frame_sequence(const ConvertJob &job, const PngOptions &png_options, size_t window,
+                            bool macroblock_cache, bool reuse_macroblocks, MdecStats *stats)
+{
+    std::vector<uint16_t> words;
+    bool read;
+    {
+        MDEC_STAGE_TIMER(stats, MDEC_STAGE_READ);
+        TraceScope trace("read");
+        read = read_mdec_file(job.input.c_str(), words);
+    }
+    if (!read)
+    {
+        std::cerr << "Error: Could not read input file " << job.input << std::endl;
+        return false;
+    }
+    MDEC_STATS_ADD(stats, files, 1);
+    MDEC_STATS_ADD(stats, bytes_in, words.size() * sizeof(uint16_t));
+
+    FrameSequenceDecoder decoder(job.width, job.height, window);
+    MdecContext &ctx = decoder.context();
+    ctx.quant = job.quant;
+    ctx.stats = stats;
+    if (macroblock_cache)
+        ctx.macroblock_cache = std::make_unique<MacroblockCache>();
+    ctx.reuse_previous_frame = reuse_macroblocks;
+    std::vector<std::string> outputs;
+    bool ok = true;
+
+    uint16_t *data = words.data();
+    uint16_t *end = data + words.size();
+    DecodedFrame frame;
+    while (decoder.next(&data, end, frame))
+    {
+        std::string output = frame_output_path(job.output, frame.index);
+        outputs.push_back(output);
+
+        std::error_code ec;
+        fs::remove(output, ec);
+        if (frame.duplicate)
+        {
+            // Skip re-encoding: reuse the file already written for the identical frame
+            const std::string &original = outputs[frame.duplicate_of];
+            fs::create_hard_link(original, output, ec);
+            if (!ec)
+                continue;
+            ec.clear();
+            if (fs::copy_file(original, output, ec))
+                continue;
+        }
+        bool written;
+        {
+            MDEC_STAGE_TIMER(stats, MDEC_STAGE_WRITE);
+            TraceScope trace("write", (int64_t)frame.index);
+            written = write_image(output.c_str(), job.width, job.height, frame.rgb, png_options);
+        }
+        if (!written)
+        {
+            std::cerr << "Error: Could not write " << output << std::endl;
+            ok = false;
+        }
+        MDEC_STATS_ADD(stats, bytes_out, file_size_or_zero(output));
+    }
+
+    printf("Decoded %zu frames (%zu duplicates reused without decoding)\n", decoder.frames(), decoder.duplicates());
+    if (ctx.macroblock_cache || reuse_macroblocks)
+        print_macroblock_stats(ctx.macroblock_cache ? ctx.macroblock_cache->lookups : 0,
+                               ctx.macroblock_cache ? ctx.macroblock_cache->hits : 0, ctx.previous_frame_hits);
+    return ok;
+}
+
+bool convert_frames_to_ring(const ConvertJob &job, const std::string &ring_name, MdecPixelFormat format,
+                            uint32_t slots, double fps, bool macroblock_cache, MdecStats *stats)
+{
+    std::vector<uint16_t> words;
+    bool read;
+    {
+        MDEC_STAGE_TIMER(stats, MDEC_STAGE_READ);
+        TraceScope trace("read");
+        read = read_mdec_file(job.input.c_str(), words);
+    }
+    if (!read)
+    {
+        std::cerr << "Error: Could not read input file " << job.input << std::endl;
+        return false;
+    }
+    MDEC_STATS_ADD(stats, files, 1);
+    MDEC_STATS_ADD(stats, bytes_in, words.size() * sizeof(uint16_t));
+
+    FrameRing ring;
+    std::string error;
+    if (!ring.create(ring_name, job.width, job.height, format, slots, error))
+    {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
+    const FrameRingHeader &header = ring.header();
+
+    MdecContext ctx;
+    ctx.quant = job.quant;
+    ctx.stats = stats;
+    if (macroblock_cache)
+        ctx.macroblock_cache = std::make_unique<MacroblockCache>();
+
+    size_t macroblocks_per_frame = (size_t)((job.width + 15) / 16) * ((job.height + 15) / 16);
+    uint16_t *data = words.data();
+    uint16_t *end = data + words.size();
+    auto start = std::chrono::steady_clock::now();
+    uint64_t frames = 0;
+    bool waiting_reported = false;
+    while (true)
+    {
+        // Padding between frames is not part of the payload
+        while (data < end && *data == 0xfe00)
+            data++;
+        uint16_t *frame_end = data;
+        if (skip_mdec_macroblocks(&frame_end, end, macroblocks_per_frame) < macroblocks_per_frame)
+            break;
+
+        uint8_t *pixels = nullptr;
+        if (ring.acquire_write(pixels, waiting_reported ? -1 : 1000) == FRAME_RING_TIMEOUT)
+        {
+            printf("Waiting for a consumer on %s\n", ring_name.c_str());
+            fflush(stdout);
+            waiting_reported = true;
+            ring.acquire_write(pixels);
+        }
+        FrameRingSlot slot = {};
+        slot.frame_index = frames;
+        {
+            TraceScope trace("decode", (int64_t)frames);
+            slot.macroblocks = decode_mdec_frame(ctx, &data, frame_end, job.width, job.height, pixels,
+                                                 header.stride, format);
+        }
+        data = frame_end;
+
+        if (fps > 0)
+            std::this_thread::sleep_until(start + std::chrono::duration<double>(frames / fps));
+        ring.publish(slot);
+        MDEC_STATS_ADD(stats, bytes_out, header.stride * job.height);
+        frames++;
+    }
+    ring.close_producer();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Unlinking hides the ring from a consumer that has not attached yet, so let it catch up
+    if (ring.wait_drained(1000) == FRAME_RING_TIMEOUT)
+    {
+        printf("Waiting for the consumer to read the last frames\n");
+        fflush(stdout);
+        ring.wait_drained();
+    }
+
+    printf("Published %llu frames to %s in %.3f s (%.1f fps)\n", (unsigned long long)frames, ring_name.c_str(),
+           seconds, seconds > 0 ? frames / seconds : 0.0);
+    if (ctx.macroblock_cache)
+        print_macroblock_stats(ctx.macroblock_cache->lookups, ctx.macroblock_cache->hits, 0);
+    return true;
+}
+
+// Walk the command stream once, then decode its images on a worker pool
+bool convert_command_stream(const ConvertJob &job, const PngOptions &png_options, int threads, MdecStats *stats)
+{
+    std::vector<uint16_t> words;
+    bool read;
+    {
+        MDEC_STAGE_TIMER(stats, MDEC_STAGE_READ);
+        TraceScope trace("read");
+        read = read_mdec_file(job.input.c_str(), words);
+    }
+    if (!read)
+    {
+        std::cerr << "Error: Could not read input file " << job.input << std::endl;
+        return false;
+    }
+    MDEC_STATS_ADD(stats, files, 1);
+    MDEC_STATS_ADD(stats, bytes_in, words.size() * sizeof(uint16_t));
+
+    MdecCommandStream stream;
+    {
+        TraceScope trace("parse commands");
+        parse_mdec_command_stream(words.data(), words.size(), job.quant, stream);
+    }
+    printf("%zu decode, %zu set-quant, %zu set-scale and %zu other commands\n", stream.images.size(),
+           stream.quant_commands, stream.scale_commands, stream.other_commands);
+    if (stream.truncated)
+        std::cerr << "Warning: The last command of " << job.input << " is cut off" << std::endl;
+    if (std::any_of(stream.images.begin(), stream.images.end(), [](const MdecCommandImage &image)
+                    { return image.custom_scale; }))
+        std::cerr << "Warning: " << job.input
+                  << " sets a non-standard IDCT scale table; its images are decoded with the standard one" << std::endl;
+    if (stream.images.empty())
+    {
+        std::cerr << "Error: No decode commands in " << job.input << std::endl;
+        return false;
+    }
+
+    int thread_count = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+    thread_count = std::max(1, std::min(thread_count, (int)stream.images.size()));
+    std::atomic<size_t> next_image{0};
+    std::atomic<size_t> failures{0};
+    std::atomic<size_t> decoded{0};
+    std::mutex stats_mutex;
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < thread_count; t++)
+    {
+        workers.emplace_back([&, t]()
+                             {
+            trace_thread_name(("worker " + std::to_string(t)).c_str());
+            MdecContext ctx;
+            MdecStats worker_stats;
+            if (stats)
+                ctx.stats = &worker_stats;
+            std::vector<uint8_t> rgb;
+            for (size_t i = next_image++; i < stream.images.size(); i = next_image++)
+            {
+                const MdecCommandImage &image = stream.images[i];
+                int width = job.width;
+                int height = job.height;
+                if (width <= 0 && (is_mdec_mono_depth(image.depth) ||
+                                   !infer_mdec_size(image.words, image.words + image.word_count, width, height)))
+                {
+                    std::cerr << "Error: Could not infer the size of image " << i << " ("
+                              << mdec_depth_name(image.depth) << ")" << std::endl;
+                    failures++;
+                    continue;
+                }
+
+                rgb.resize((size_t)width * height * 3);
+                {
+                    TraceScope trace("decode", (int64_t)i);
+                    decoded += decode_mdec_command_image(ctx, image, width, height, rgb.data());
+                }
+                std::string output = frame_output_path(job.output, i);
+                bool written;
+                {
+                    MDEC_STAGE_TIMER(ctx.stats, MDEC_STAGE_WRITE);
+                    TraceScope trace("write", (int64_t)i);
+                    written = write_image(output.c_str(), width, height, rgb.data(), png_options);
+                }
+                if (!written)
+                {
+                    std::cerr << "Error: Could not write " << output << std::endl;
+                    failures++;
+                    continue;
+                }
+                MDEC_STATS_ADD(ctx.stats, bytes_out, file_size_or_zero(output));
+            }
+            if (stats)
+            {
+                std::lock_guard<std::mutex> lock(stats_mutex);
+                stats->merge(worker_stats);
+            } });
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Decoded %zu/%zu images (%zu macroblocks or mono blocks) in %.3f s on %d threads\n",
+           stream.images.size() - failures, stream.images.size(), decoded.load(), seconds, thread_count);
+    return failures == 0;
+}
+
+// Shell-style match of '*' and '?' against a file name
+static bool wildcard_match(const char *pattern, const char *name)
+{
+    if (*pattern == '\0')
+        return *name == '\0';
+    if (*pattern == '*')
+        return wildcard_match(pattern + 1, name) || (*name && wildcard_match(pattern, name + 1));
+    if (*name && (*pattern == '?' || *pattern == *name))
+        return wildcard_match(pattern + 1, name + 1);
+    return false;
+}
+
+static std::string output_path_for(const fs::path &input, const BatchOptions &options)
+{
+    fs::path out = fs::path(options.output_dir) / input.stem();
+    out += "." + options.format;
+    return out.string();
+}
+
+bool collect_batch_jobs(const std::string &source, const BatchOptions &options,
+                        std::vector<ConvertJob> &jobs, std::string &error)
+{
+    std::error_code ec;
+    fs::path src(source);
+    bool is_glob = source.find_first_of("*?") != std::string::npos;
+
+    if (is_glob || fs::is_directory(src, ec))
+    {
+        fs::path dir = is_glob ? src.parent_path() : src;
+        std::string pattern = is_glob ? src.filename().string() : "*.bin";
+        if (dir.empty())
+            dir = ".";
+
+        std::vector<fs::path> inputs;
+        for (const fs::directory_entry &entry : fs::directory_iterator(dir, ec))
+        {
+            if (entry.is_regular_file() && wildcard_match(pattern.c_str(), entry.path().filename().string().c_str()))
+                inputs.push_back(entry.path());
+        }
+        if (ec)
+        {
+            error = "could not list " + dir.string() + ": " + ec.message();
+            return false;
+        }
+        std::sort(inputs.begin(), inputs.end());
+
+        for (const fs::path &input : inputs)
+            jobs.push_back(
+                {input.string(), options.width, options.height, output_path_for(input, options), options.quant});
+        return true;
+    }
+
+    // Manifest: path width height [output]
+    std::ifstream manifest(source);
+    if (!manifest)
+    {
+        error = "could not open " + source;
+        return false;
+    }
+    std::string line;
+    int line_number = 0;
+    while (std::getline(manifest, line))
+    {
+        line_number++;
+        std::istringstream fields(line);
+        ConvertJob job;
+        job.quant = options.quant;
+        if (!(fields >> job.input) || job.input[0] == '#')
+            continue;
+        if (!(fields >> job.width >> job.height) || job.width < 0 || job.height < 0)
+        {
+            error = source + ":" + std::to_string(line_number) + ": expected \"path width height [output]\"";
+            return false;
+        }
+        std::string output;
+        if (fields >> output)
+            job.output = (fs::path(options.output_dir) / output).string(); // absolute outputs replace the directory
+        else
+            job.output = output_path_for(job.input, options);
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+size_t run_batch(const std::vector<ConvertJob> &jobs, const BatchOptions &options)
+{
+    std::error_code ec;
+    fs::create_directories(options.output_dir, ec);
+
+    int thread_count = options.threads > 0 ? options.threads : (int)std::thread::hardware_concurrency();
+    thread_count = std::max(1, std::min(thread_count, (int)jobs.size()));
+
+    std::atomic<size_t> next_job{0};
+    std::atomic<size_t> failures{0};
+    std::atomic<size_t> bytes_in{0};
+    std::atomic<size_t> macroblocks{0};
+    std::atomic<uint64_t> mb_lookups{0};
+    std::atomic<uint64_t> mb_hits{0};
+    std::mutex stats_mutex;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; t++)
+    {
+        threads.emplace_back([&, t]()
+                             {
+            trace_thread_name(("worker " + std::to_string(t)).c_str());
+            ConvertWorker worker;
+            MdecStats worker_stats;
+            if (options.macroblock_cache)
+                worker.ctx.macroblock_cache = std::make_unique<MacroblockCache>();
+            if (options.stats)
+                worker.ctx.stats = &worker_stats;
+            for (size_t i = next_job++; i < jobs.size(); i = next_job++)
+            {
+                if (!convert_file(worker, jobs[i], options.png, options.cache))
+                    failures++;
+                bytes_in += worker.input_bytes;
+                macroblocks += worker.macroblocks;
+            }
+            if (worker.ctx.macroblock_cache)
+            {
+                mb_lookups += worker.ctx.macroblock_cache->lookups;
+                mb_hits += worker.ctx.macroblock_cache->hits;
+            }
+            if (options.stats)
+            {
+                std::lock_guard<std::mutex> lock(stats_mutex);
+                options.stats->merge(worker_stats);
+            } });
+    }
+    for (std::thread &t : threads)
+        t.join();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double mb = bytes_in / (1024.0 * 1024.0);
+    size_t converted = jobs.size() - failures;
+    printf("Converted %zu/%zu files (%zu macroblocks, %.2f MB) in %.3f s on %d threads: %.1f files/s, %.2f MB/s\n",
+           converted, jobs.size(), macroblocks.load(), mb, seconds, thread_count,
+           seconds > 0 ? converted / seconds : 0.0, seconds > 0 ? mb / seconds : 0.0);
+    if (options.cache)
+        options.cache->print_stats();
+    if (options.macroblock_cache)
+        print_macroblock_stats(mb_lookups, mb_hits, 0);
+    return failures;
+}
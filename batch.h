@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "image_writer.h"
+#include "mdec.h"
+#include "output_cache.h"
+
+// One input file to convert
+struct ConvertJob
+{
+    std::string input;
+    int width = 0; // 0 = infer from the macroblock stream
+    int height = 0;
+    std::string output;
+    const MdecQuantTables *quant = mdec_default_quant_tables(); // e.g. a game's own tables
+};
+
+// Buffers owned by one conversion thread and reused from file to file
+struct ConvertWorker
+{
+    MdecContext ctx;
+    std::vector<uint16_t> words;
+    std::vector<uint8_t> image;
+
+    // Results of the last convert_file call
+    int width = 0; // as given by the job, or inferred
+    int height = 0;
+    size_t macroblocks = 0;
+    size_t input_bytes = 0;
+    bool cached = false;
+};
+
+// Read, decode and write a single file. With a cache, unchanged inputs are served from it
+// without decoding.
+bool convert_file(ConvertWorker &worker, const ConvertJob &job, const PngOptions &png_options,
+                  OutputCache *cache = nullptr);
+
+// The same for words already in worker.words; job.input is only used in messages
+bool convert_words(ConvertWorker &worker, const ConvertJob &job, const PngOptions &png_options,
+                   OutputCache *cache = nullptr);
+
+// Decode only the width x height pixel rectangle at (x, y) of job.input and write it to
+// job.output, through a TiledDecoder so the rest of the image is indexed but not decoded
+bool convert_region(const ConvertJob &job, int x, int y, int width, int height, const PngOptions &png_options);
+
+// Decode a stream of back-to-back frames of job.width x job.height. job.output is a
+// printf-style pattern such as frame_%04d.png; without a '%' the frame number is appended
+// to the file name. Duplicate frames are hard-linked (or copied) from the earlier output
+// instead of being decoded and encoded again. Returns false if any frame failed to write.
+// macroblock_cache and reuse_macroblocks enable the MdecContext macroblock cache and the
+// same-position previous-frame check. With stats, stage timings and counters are added to it.
+bool convert_frame_sequence(const ConvertJob &job, const PngOptions &png_options, size_t window,
+                            bool macroblock_cache, bool reuse_macroblocks, MdecStats *stats = nullptr);
+
+// Decode the same kind of stream straight into the slots of a shared-memory frame ring named
+// ring_name (see frame_ring.h) for a consumer process to read in place. Blocks while the
+// consumer is a full ring behind; with fps > 0 frames are also published no faster than that.
+// The ring is closed and unlinked once the last frame has been published.
+bool convert_frames_to_ring(const ConvertJob &job, const std::string &ring_name, MdecPixelFormat format,
+                            uint32_t slots, double fps, bool macroblock_cache, MdecStats *stats = nullptr);
+
+// Decode every image of a raw MDEC command stream (see command_stream.h) in job.input to the
+// printf-style pattern job.output, applying its set-quant commands on top of job.quant and each
+// decode command's output depth. Images are job.width x job.height, or inferred per colour
+// image when 0. The command walk only records where each image lies, so up to threads workers
+// (0 = one per hardware thread) then decode and write the images in parallel. Returns false if
+// any image failed.
+bool convert_command_stream(const ConvertJob &job, const PngOptions &png_options, int threads,
+                            MdecStats *stats = nullptr);
+
+// Print hit rates of a context's macroblock reuse
+void print_macroblock_stats(uint64_t lookups, uint64_t hits, uint64_t previous_frame_hits);
+
+struct BatchOptions
+{
+    int width = 0;  // used for inputs without a manifest entry; 0 = infer per file
+    int height = 0;
+    std::string output_dir = ".";
+    std::string format = "png"; // output extension for inputs without an explicit output
+    int threads = 0;            // 0 = one per hardware thread
+    PngOptions png;
+    OutputCache *cache = nullptr;
+    bool macroblock_cache = false; // per-worker MacroblockCache
+    MdecStats *stats = nullptr;    // per-worker totals are merged here when set
+    const MdecQuantTables *quant = mdec_default_quant_tables(); // for every job
+};
+
+// Expand a batch source into jobs. The source may be a directory (every .bin in it),
+// a glob such as dir/*.bin (wildcards in the file name only), or a manifest file with one
+// "path width height [output]" entry per line (0 0 to infer the size); blank lines and lines
+// starting with # are skipped.
+// Relative outputs are placed in options.output_dir.
+bool collect_batch_jobs(const std::string &source, const BatchOptions &options,
+                        std::vector<ConvertJob> &jobs, std::string &error);
+
+// Convert all jobs on a pool of options.threads workers and print a throughput summary.
+// Returns the number of failed jobs.
+size_t run_batch(const std::vector<ConvertJob> &jobs, const BatchOptions &options);
@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mdec.h"
+#include "synthetic_stream.h"
+
+namespace fs = std::filesystem;
+
+static void print_usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options]" << std::endl
+              << "  --file PATH WxH  add a real MDEC stream to the corpus (repeatable)" << std::endl
+              << "  --reps N         timed repetitions per benchmark (default 20)" << std::endl
+              << "  --warmup N       untimed repetitions before timing (default 2)" << std::endl
+              << "  --json PATH      also write the results as JSON" << std::endl;
+}
+
+struct Corpus
+{
+    std::string name;
+    int width = 0;
+    int height = 0;
+    int density = -1; // AC coefficients per block, -1 for real data
+    std::vector<uint16_t> words;
+    size_t macroblocks = 0;
+};
+
+struct Result
+{
+    std::string stage;
+    const Corpus *corpus;
+    size_t blocks; // kernel invocations per repetition
+    std::vector<double> seconds;
+
+    double median() const
+    {
+        std::vector<double> sorted = seconds;
+        std::sort(sorted.begin(), sorted.end());
+        size_t n = sorted.size();
+        return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    }
+    double min() const { return *std::min_element(seconds.begin(), seconds.end()); }
+    double mean() const
+    {
+        double sum = 0.0;
+        for (double s : seconds)
+            sum += s;
+        return sum / seconds.size();
+    }
+    double stddev() const
+    {
+        double m = mean(), sum = 0.0;
+        for (double s : seconds)
+            sum += (s - m) * (s - m);
+        return seconds.size() > 1 ? std::sqrt(sum / (seconds.size() - 1)) : 0.0;
+    }
+};
+
+// Synthetic frame with exactly density AC levels in every block
+static void make_synthetic(Corpus &corpus, uint64_t seed)
+{
+    SyntheticStreamOptions options;
+    options.width = corpus.width;
+    options.height = corpus.height;
+    options.density = corpus.density;
+    options.seed = seed;
+    SyntheticStreamGenerator generator(options);
+    generator.next_frame(corpus.words);
+    corpus.macroblocks = generator.macroblocks_per_frame();
+}
+
+// Untimed warm-up passes, then one timing sample per pass over the corpus
+static std::vector<double> measure(const std::function<void()> &pass, int warmup, int reps)
+{
+    for (int i = 0; i < warmup; i++)
+        pass();
+    std::vector<double> seconds;
+    for (int i = 0; i < reps; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        pass();
+        seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return seconds;
+}
+
+static const MdecBlockType block_types[6] = {MDEC_BLOCK_CR, MDEC_BLOCK_CB, MDEC_BLOCK_Y,
+                                             MDEC_BLOCK_Y, MDEC_BLOCK_Y, MDEC_BLOCK_Y};
+
+// Keeps the benchmarked work observable
+static volatile uint64_t sink;
+
+static void bench_corpus(Corpus &corpus, int warmup, int reps, std::vector<Result> &results)
+{
+    uint16_t *begin = corpus.words.data();
+    uint16_t *end = begin + corpus.words.size();
+    size_t blocks = corpus.macroblocks * 6;
+    MdecContext ctx;
+
+    // Inputs for the isolated stages: dequantised blocks, then IDCT output
+    std::vector<int16_t> coefficients(blocks * 64);
+    std::vector<int16_t> pixels(blocks * 64);
+    uint16_t *data = begin;
+    for (size_t b = 0; b < blocks; b++)
+    {
+        rle_decode(ctx, &data, &coefficients[b * 64], block_types[b % 6], end);
+        int16_t src[8][8];
+        memcpy(src, &coefficients[b * 64], sizeof(src));
+        idct_core(src, reinterpret_cast<int16_t(*)[8]>(&pixels[b * 64]));
+    }
+
+    std::vector<uint8_t> patch(16 * 16 * 3);
+    std::vector<uint8_t> frame((size_t)corpus.width * corpus.height * 3);
+
+    auto rle_pass = [&]()
+    {
+        uint16_t *p = begin;
+        int16_t blk[64];
+        uint64_t sum = 0;
+        for (size_t b = 0; b < blocks; b++)
+        {
+            rle_decode(ctx, &p, blk, block_types[b % 6], end);
+            sum += blk[0];
+        }
+        sink = sum;
+    };
+
+    auto idct_pass = [&]()
+    {
+        int16_t src[8][8], dst[8][8];
+        uint64_t sum = 0;
+        for (size_t b = 0; b < blocks; b++)
+        {
+            memcpy(src, &coefficients[b * 64], sizeof(src));
+            idct_core(src, dst);
+            sum += dst[3][3];
+        }
+        sink = sum;
+    };
+
+    // Four luma blocks per macroblock, each sharing the macroblock's chroma
+    auto yuv_pass = [&]()
+    {
+        auto block = [&](size_t b)
+        { return reinterpret_cast<int16_t(*)[8]>(&pixels[b * 64]); };
+        for (size_t mb = 0; mb < corpus.macroblocks; mb++)
+        {
+            size_t b = mb * 6;
+            yuv_to_rgb(block(b + 2), block(b + 1), block(b), 0, 0, 0, 0, patch.data(), 16);
+            yuv_to_rgb(block(b + 3), block(b + 1), block(b), 0, 0, 8, 0, patch.data(), 16);
+            yuv_to_rgb(block(b + 4), block(b + 1), block(b), 0, 0, 0, 8, patch.data(), 16);
+            yuv_to_rgb(block(b + 5), block(b + 1), block(b), 0, 0, 8, 8, patch.data(), 16);
+        }
+        sink = patch[0];
+    };
+
+    auto macroblock_pass = [&]()
+    {
+        uint16_t *p = begin;
+        for (size_t mb = 0; mb < corpus.macroblocks; mb++)
+            process_macroblock(ctx, &p, patch.data(), end, 16, 0, 0);
+        sink = patch[0];
+    };
+
+    auto frame_pass = [&]()
+    {
+        uint16_t *p = begin;
+        decode_mdec_frame(ctx, &p, end, corpus.width, corpus.height, frame.data());
+        sink = frame[0];
+    };
+
+    results.push_back({"rle_decode", &corpus, blocks, measure(rle_pass, warmup, reps)});
+    ctx.scalar_rle = true;
+    results.push_back({"rle_decode scalar", &corpus, blocks, measure(rle_pass, warmup, reps)});
+    ctx.scalar_rle = false;
+    results.push_back({"idct_core", &corpus, blocks, measure(idct_pass, warmup, reps)});
+    results.push_back({"yuv_to_rgb", &corpus, corpus.macroblocks * 4, measure(yuv_pass, warmup, reps)});
+    results.push_back({"process_macroblock", &corpus, blocks, measure(macroblock_pass, warmup, reps)});
+    results.push_back({"decode_mdec_frame", &corpus, blocks, measure(frame_pass, warmup, reps)});
+    if (mdec_has_fixed_pipeline(corpus.width, corpus.height, MDEC_PIXEL_FORMAT_RGB24))
+    {
+        ctx.generic_reassembly = true;
+        results.push_back({"decode_mdec_frame generic", &corpus, blocks, measure(frame_pass, warmup, reps)});
+        ctx.generic_reassembly = false;
+    }
+}
+
+static void print_results(const std::vector<Result> &results)
+{
+    printf("%-20s %-24s %10s %12s %14s %10s %8s\n", "stage", "corpus", "ns/block", "median ms", "macroblocks/s",
+           "MB/s", "stddev");
+    for (const Result &r : results)
+    {
+        double median = r.median();
+        double bytes = r.corpus->words.size() * sizeof(uint16_t);
+        printf("%-20s %-24s %10.1f %12.3f %14.0f %10.1f %7.1f%%\n", r.stage.c_str(), r.corpus->name.c_str(),
+               median * 1e9 / r.blocks, median * 1e3, r.corpus->macroblocks / median, bytes / median / 1e6,
+               100.0 * r.stddev() / r.mean());
+    }
+}
+
+static bool write_json(const char *path, const std::vector<Result> &results, int warmup, int reps)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        std::cerr << "Error: Could not open output file " << path << std::endl;
+        return false;
+    }
+    fprintf(out, "{\n  \"decoder_revision\": %d,\n  \"warmup\": %d,\n  \"repetitions\": %d,\n  \"results\": [\n",
+            MDEC_DECODER_REVISION, warmup, reps);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &r = results[i];
+        double median = r.median();
+        double bytes = r.corpus->words.size() * sizeof(uint16_t);
+        fprintf(out,
+                "    {\"stage\": \"%s\", \"corpus\": \"%s\", \"width\": %d, \"height\": %d, \"density\": %d, "
+                "\"macroblocks\": %zu, \"blocks\": %zu, \"input_bytes\": %.0f, "
+                "\"median_s\": %.9f, \"min_s\": %.9f, \"mean_s\": %.9f, \"stddev_s\": %.9f, "
+                "\"ns_per_block\": %.3f, \"macroblocks_per_s\": %.1f, \"mb_per_s\": %.3f}%s\n",
+                r.stage.c_str(), r.corpus->name.c_str(), r.corpus->width, r.corpus->height, r.corpus->density,
+                r.corpus->macroblocks, r.blocks, bytes, median, r.min(), r.mean(), r.stddev(),
+                median * 1e9 / r.blocks, r.corpus->macroblocks / median, bytes / median / 1e6,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    fclose(out);
+    return true;
+}
+
+// Microbenchmarks for the decoder stages on synthetic and real streams
+int main(int argc, char *argv[])
+{
+    std::vector<Corpus> corpora;
+    const char *json_path = nullptr;
+    int reps = 20, warmup = 2;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--file" && i + 2 < argc)
+        {
+            Corpus corpus;
+            corpus.name = fs::path(argv[i + 1]).filename().string();
+            if (sscanf(argv[i + 2], "%dx%d", &corpus.width, &corpus.height) != 2 ||
+                !read_mdec_file(argv[i + 1], corpus.words))
+            {
+                std::cerr << "Error: Could not load " << argv[i + 1] << std::endl;
+                return 1;
+            }
+            corpora.push_back(std::move(corpus));
+            i += 2;
+        }
+        else if (arg == "--reps" && i + 1 < argc)
+            reps = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--warmup" && i + 1 < argc)
+            warmup = std::max(0, std::stoi(argv[++i]));
+        else if (arg == "--json" && i + 1 < argc)
+            json_path = argv[++i];
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Count the macroblocks of real streams; synthetic ones know theirs
+    for (Corpus &corpus : corpora)
+    {
+        uint16_t *p = corpus.words.data();
+        corpus.macroblocks = skip_mdec_macroblocks(&p, p + corpus.words.size(), SIZE_MAX);
+    }
+
+#ifdef MDEC_EXAMPLES_DIR
+    if (corpora.empty())
+    {
+        Corpus example;
+        example.name = "hod_loading.bin";
+        example.width = 256;
+        example.height = 192;
+        if (read_mdec_file(MDEC_EXAMPLES_DIR "/hod_loading.bin", example.words))
+        {
+            uint16_t *p = example.words.data();
+            example.macroblocks = skip_mdec_macroblocks(&p, p + example.words.size(), SIZE_MAX);
+            corpora.push_back(std::move(example));
+        }
+    }
+#endif
+
+    const int sizes[][2] = {{320, 240}, {640, 480}, {1024, 768}};
+    const int densities[] = {2, 8, 24};
+    uint64_t seed = 1;
+    for (const int *size : sizes)
+    {
+        for (int density : densities)
+        {
+            Corpus corpus;
+            corpus.width = size[0];
+            corpus.height = size[1];
+            corpus.density = density;
+            corpus.name = std::to_string(size[0]) + "x" + std::to_string(size[1]) + " ac" + std::to_string(density);
+            make_synthetic(corpus, seed++);
+            corpora.push_back(std::move(corpus));
+        }
+    }
+
+    std::vector<Result> results;
+    for (Corpus &corpus : corpora)
+        bench_corpus(corpus, warmup, reps, results);
+
+    print_results(results);
+    if (json_path && !write_json(json_path, results, warmup, reps))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define MDEC_HAVE_SHM 1
+#endif
+
+#include "decode_server.h"
+#include "dimensions.h"
+#include "hash.h"
+#include "mdec.h"
+
+static void print_usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " <socket> <input.bin> <width> <height> [output] [options]" << std::endl
+              << "       " << program << " <socket> <input.bin> auto [output] [options]" << std::endl
+              << "       " << program << " <socket> --shutdown" << std::endl
+              << "Without an output the server only decodes. Paths are resolved by the server." << std::endl
+              << "  --inline         send the input words instead of the path" << std::endl
+              << "  --shm NAME       decode into shared-memory object NAME and print a hash of the pixels" << std::endl
+              << "  --format F       --shm pixel format: rgb24, bgr24, rgba32 or bgra32 (default rgb24)" << std::endl
+              << "  --load N         send the request N times and report throughput and latency" << std::endl
+              << "  --connections C  parallel connections for --load (default 4)" << std::endl;
+}
+
+static bool parse_pixel_format(const std::string &name, uint32_t &format)
+{
+    const char *names[] = {"rgb24", "bgr24", "rgba32", "bgra32"};
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        if (name == names[i])
+        {
+            format = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static double percentile(std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+// Send decode requests to a running `mdec_decoder --serve`
+int main(int argc, char *argv[])
+{
+    std::vector<const char *> args;
+    DecodeRequestHeader request;
+    const char *shm_name = nullptr;
+    size_t load = 0;
+    int connection_count = 4;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool ok = true;
+        if (arg == "--inline")
+            request.flags |= DECODE_REQUEST_INLINE;
+        else if (arg == "--shm" && i + 1 < argc)
+            shm_name = argv[++i];
+        else if (arg == "--format" && i + 1 < argc)
+            ok = parse_pixel_format(argv[++i], request.pixel_format);
+        else if (arg == "--load" && i + 1 < argc)
+            load = std::stoul(argv[++i]);
+        else if (arg == "--connections" && i + 1 < argc)
+            connection_count = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--shutdown")
+            request.flags |= DECODE_REQUEST_SHUTDOWN;
+        else
+            args.push_back(argv[i]);
+        if (!ok)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::string error;
+    std::string message;
+    DecodeResponseHeader response;
+    if (args.size() == 1 && (request.flags & DECODE_REQUEST_SHUTDOWN))
+    {
+        // An empty decode-only request carries the shutdown flag
+        DecodeClient client;
+        request.width = request.height = 16;
+        request.flags |= DECODE_REQUEST_INLINE;
+        if (!client.connect(args[0], error) || !client.decode(request, "", "", nullptr, response, message, error))
+        {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    bool infer = args.size() >= 3 && std::string(args[2]) == "auto";
+    if (args.size() < (infer ? 3u : 4u))
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+    std::string socket_path = args[0];
+    std::string input = args[1];
+    if (!infer)
+    {
+        request.width = std::stoi(args[2]);
+        request.height = std::stoi(args[3]);
+    }
+    size_t output_arg = infer ? 3 : 4;
+    std::string output = args.size() > output_arg ? args[output_arg] : "";
+
+    // The client needs the words for inline requests, and the size to create shared memory
+    std::vector<uint16_t> words;
+    if ((request.flags & DECODE_REQUEST_INLINE) || (shm_name && infer))
+    {
+        if (!read_mdec_file(input.c_str(), words))
+        {
+            std::cerr << "Error: Could not read input file " << input << std::endl;
+            return 1;
+        }
+        request.payload_bytes = words.size() * sizeof(uint16_t);
+    }
+
+#ifdef MDEC_HAVE_SHM
+    uint8_t *pixels = nullptr;
+    size_t shm_bytes = 0;
+    if (shm_name)
+    {
+        if (infer && !infer_mdec_size(words.data(), words.data() + words.size(), request.width, request.height))
+        {
+            std::cerr << "Error: Could not infer the size of " << input << std::endl;
+            return 1;
+        }
+        request.flags |= DECODE_REQUEST_SHM;
+        output = shm_name;
+        shm_bytes = (size_t)request.width * request.height * mdec_pixel_size((MdecPixelFormat)request.pixel_format);
+        int fd = shm_open(shm_name, O_RDWR | O_CREAT, 0600);
+        if (fd < 0 || ftruncate(fd, (off_t)shm_bytes) != 0)
+        {
+            std::cerr << "Error: Could not create shared memory " << shm_name << std::endl;
+            return 1;
+        }
+        pixels = (uint8_t *)mmap(nullptr, shm_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (pixels == MAP_FAILED)
+        {
+            std::cerr << "Error: Could not map shared memory " << shm_name << std::endl;
+            return 1;
+        }
+    }
+#else
+    if (shm_name)
+    {
+        std::cerr << "Error: Shared memory is not available on this platform" << std::endl;
+        return 1;
+    }
+#endif
+
+    int status = 0;
+    if (load == 0)
+    {
+        DecodeClient client;
+        auto start = std::chrono::steady_clock::now();
+        if (!client.connect(socket_path, error) ||
+            !client.decode(request, input, output, words.data(), response, message, error))
+        {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        double round_trip = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        if (response.status != 0)
+        {
+            std::cerr << "Error: " << message << std::endl;
+            status = 1;
+        }
+        else
+            printf("Decoded %dx%d (%llu macroblocks): %llu us in the server, %.0f us round trip\n", response.width,
+                   response.height, (unsigned long long)response.macroblocks, (unsigned long long)response.total_us,
+                   round_trip);
+    }
+    else
+    {
+        // Each connection sends its share of the requests back to back
+        std::vector<std::vector<double>> latencies(connection_count);
+        std::vector<uint64_t> server_us(connection_count, 0);
+        std::atomic<size_t> next_request{0};
+        std::atomic<size_t> failures{0};
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int c = 0; c < connection_count; c++)
+        {
+            threads.emplace_back([&, c]()
+                                 {
+                DecodeClient client;
+                std::string thread_error;
+                if (!client.connect(socket_path, thread_error))
+                {
+                    std::cerr << "Error: " << thread_error << std::endl;
+                    failures++;
+                    return;
+                }
+                DecodeResponseHeader thread_response;
+                std::string thread_message;
+                for (size_t i = next_request++; i < load; i = next_request++)
+                {
+                    auto sent = std::chrono::steady_clock::now();
+                    if (!client.decode(request, input, output, words.data(), thread_response, thread_message,
+                                       thread_error) ||
+                        thread_response.status != 0)
+                    {
+                        failures++;
+                        continue;
+                    }
+                    latencies[c].push_back(
+                        std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent).count());
+                    server_us[c] += thread_response.decode_us;
+                } });
+        }
+        for (std::thread &t : threads)
+            t.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<double> all;
+        uint64_t decode_us = 0;
+        for (int c = 0; c < connection_count; c++)
+        {
+            all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+            decode_us += server_us[c];
+        }
+        std::sort(all.begin(), all.end());
+        printf("%zu requests on %d connections in %.3f s: %.1f requests/s\n", all.size(), connection_count, seconds,
+               seconds > 0 ? all.size() / seconds : 0.0);
+        printf("Latency p50 %.0f us, p99 %.0f us, max %.0f us; server decode %.0f us mean\n", percentile(all, 0.5),
+               percentile(all, 0.99), all.empty() ? 0.0 : all.back(), all.empty() ? 0.0 : (double)decode_us / all.size());
+        if (failures)
+        {
+            std::cerr << "Error: " << failures.load() << " requests failed" << std::endl;
+            status = 1;
+        }
+    }
+
+#ifdef MDEC_HAVE_SHM
+    if (pixels)
+    {
+        if (status == 0)
+            printf("Pixel hash %016llx\n", (unsigned long long)mdec_hash64(pixels, shm_bytes));
+        munmap(pixels, shm_bytes);
+        shm_unlink(shm_name);
+    }
+#endif
+    return status;
+}
@@ -0,0 +1,36 @@
+# Publish a generated stream through a frame ring and check the consumer reads as many frames
+# as --frames writes to files. Run by ctest with -D BIN_DIR=... -D WORK_DIR=... -D SIZE=WxH.
+string(REPLACE "x" ";" dimensions ${SIZE})
+list(GET dimensions 0 width)
+list(GET dimensions 1 height)
+set(stream ${WORK_DIR}/ring_${SIZE}.bin)
+set(ring /mdec_ctest_ring_${SIZE})
+
+execute_process(COMMAND ${BIN_DIR}/mdec_gen ${stream} --size ${SIZE} --frames 3 RESULT_VARIABLE result)
+if(result)
+    message(FATAL_ERROR "mdec_gen failed")
+endif()
+
+execute_process(COMMAND ${BIN_DIR}/mdec_decoder --frames ${stream} ${width} ${height} ${WORK_DIR}/ring_${SIZE}_%04d.ppm
+    OUTPUT_VARIABLE files_output RESULT_VARIABLE result)
+if(result OR NOT files_output MATCHES "Decoded ([0-9]+) frames")
+    message(FATAL_ERROR "--frames failed: ${files_output}")
+endif()
+set(file_frames ${CMAKE_MATCH_1})
+
+# A ring left by a run that was killed would be found by the consumer before the producer
+# replaces it
+file(REMOVE /dev/shm${ring})
+
+# Both run at once; the producer's output goes to the consumer's ignored stdin
+execute_process(COMMAND ${BIN_DIR}/mdec_decoder --frames ${stream} ${width} ${height} --ring ${ring}
+    COMMAND ${BIN_DIR}/mdec_ring_consumer ${ring} --wait 10
+    OUTPUT_VARIABLE ring_output RESULT_VARIABLE result TIMEOUT 30)
+if(result OR NOT ring_output MATCHES "Read ([0-9]+) frames")
+    message(FATAL_ERROR "--ring failed: ${ring_output}")
+endif()
+set(ring_frames ${CMAKE_MATCH_1})
+
+if(NOT file_frames EQUAL 3 OR NOT ring_frames EQUAL file_frames)
+    message(FATAL_ERROR "--frames wrote ${file_frames} frames, the ring published ${ring_frames}, expected 3")
+endif()
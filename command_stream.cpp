@@ -0,0 +1,125 @@
+#include "command_stream.h"
+
+#include <algorithm>
+#include <cstring>
+
+const char *mdec_depth_name(MdecOutputDepth depth)
+{
+    switch (depth)
+    {
+    case MDEC_DEPTH_4BIT:
+        return "4-bit mono";
+    case MDEC_DEPTH_8BIT:
+        return "8-bit mono";
+    case MDEC_DEPTH_24BIT:
+        return "24-bit";
+    case MDEC_DEPTH_15BIT:
+        return "15-bit";
+    }
+    return "unknown";
+}
+
+void parse_mdec_command_stream(const uint16_t *words, size_t count, const MdecQuantTables *quant,
+                               MdecCommandStream &stream)
+{
+    stream = MdecCommandStream();
+    bool custom_scale = false;
+    size_t i = 0;
+    while (i + 2 <= count)
+    {
+        uint32_t command = words[i] | (uint32_t)words[i + 1] << 16;
+        size_t parameters = count - i - 2; // 16-bit words left after the command word
+        switch (command >> 29)
+        {
+        case 1:
+        {
+            MdecCommandImage image;
+            image.offset = i;
+            image.words = words + i + 2;
+            image.word_count = (size_t)(command & 0xffff) * 2;
+            if (image.word_count > parameters)
+            {
+                image.word_count = parameters;
+                stream.truncated = true;
+            }
+            image.depth = (MdecOutputDepth)((command >> 27) & 3);
+            image.signed_output = (command >> 26) & 1;
+            image.set_bit15 = (command >> 25) & 1;
+            image.quant = quant;
+            image.custom_scale = custom_scale;
+            stream.images.push_back(image);
+            i += 2 + image.word_count;
+            break;
+        }
+        case 2:
+        {
+            // The tables are bytes in the order the MDEC receives them
+            uint32_t payload[33];
+            size_t size = std::min(parameters / 2 + 1, (size_t)33);
+            memcpy(payload, words + i, size * 4);
+            size_t used = parse_mdec_set_quant(payload, size, quant, &quant);
+            if (!used)
+            {
+                stream.truncated = true;
+                return;
+            }
+            stream.quant_commands++;
+            i += used * 2;
+            break;
+        }
+        case 3:
+            if (parameters < 64)
+            {
+                stream.truncated = true;
+                return;
+            }
+            custom_scale = memcmp(words + i + 2, scale_table.data(), 64 * sizeof(uint16_t)) != 0;
+            stream.scale_commands++;
+            i += 2 + 64;
+            break;
+        default:
+            // No parameters: bits 15-0 are only mirrored into the status register
+            stream.other_commands++;
+            i += 2;
+            break;
+        }
+    }
+}
+
+size_t decode_mdec_command_image(MdecContext &ctx, const MdecCommandImage &image, int width, int height,
+                                 uint8_t *rgb)
+{
+    ctx.quant = image.quant;
+    // Only read: the decode functions take mutable pointers
+    uint16_t *data = const_cast<uint16_t *>(image.words);
+    uint16_t *end = data + image.word_count;
+    size_t pixels = (size_t)width * height;
+
+    if (is_mdec_mono_depth(image.depth))
+    {
+        // Decode into the last third of rgb. Expanding front to back never overwrites a grey
+        // byte before it has been read.
+        uint8_t *grey = rgb + pixels * 2;
+        memset(grey, 0, pixels);
+        size_t blocks = decode_mdec_mono_frame(ctx, &data, end, width, height, grey);
+        int mask = image.depth == MDEC_DEPTH_4BIT ? 0xf0 : 0xff;
+        for (size_t i = 0; i < pixels; i++)
+        {
+            uint8_t value = grey[i] & mask;
+            if (image.depth == MDEC_DEPTH_4BIT)
+                value |= value >> 4;
+            rgb[i * 3] = rgb[i * 3 + 1] = rgb[i * 3 + 2] = value;
+        }
+        return blocks;
+    }
+
+    memset(rgb, 0, pixels * 3);
+    size_t macroblocks = decode_mdec_frame(ctx, &data, end, width, height, rgb);
+    if (image.depth == MDEC_DEPTH_15BIT)
+    {
+        // Keep the top five bits, widened back so white stays white
+        for (size_t i = 0; i < pixels * 3; i++)
+            rgb[i] = (uint8_t)((rgb[i] & 0xf8) | rgb[i] >> 5);
+    }
+    return macroblocks;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mdec.h"
+
+// Raw MDEC command streams, as captured from the MDEC's input DMA by emulators or stored by some
+// games: 32-bit command words (two host-order 16-bit words, low half first), each followed by
+// its parameters. Command 1 (0x2/0x3xxxxxxx) decodes the RLE words in its parameters, command 2
+// (0x4000000x) sets quantisation tables, command 3 (0x6xxxxxxx) sets the IDCT scale table.
+
+// Output depth, bits 28-27 of a decode command
+enum MdecOutputDepth
+{
+    MDEC_DEPTH_4BIT = 0, // monochrome
+    MDEC_DEPTH_8BIT = 1, // monochrome
+    MDEC_DEPTH_24BIT = 2,
+    MDEC_DEPTH_15BIT = 3
+};
+
+inline bool is_mdec_mono_depth(MdecOutputDepth depth)
+{
+    return depth == MDEC_DEPTH_4BIT || depth == MDEC_DEPTH_8BIT;
+}
+
+const char *mdec_depth_name(MdecOutputDepth depth);
+
+// One decode command
+struct MdecCommandImage
+{
+    size_t offset = 0;               // of the command word, in 16-bit words from the stream start
+    const uint16_t *words = nullptr; // RLE words, in place in the stream
+    size_t word_count = 0;           // fewer than the command asked for if the stream ends first
+    MdecOutputDepth depth = MDEC_DEPTH_24BIT;
+    bool signed_output = false; // bit 26; images are written unsigned either way
+    bool set_bit15 = false;     // bit 25, the 15-bit mask bit
+    const MdecQuantTables *quant = nullptr; // set by the last set-quant before it
+    bool custom_scale = false;              // a set-scale before it uploaded a non-standard table
+};
+
+struct MdecCommandStream
+{
+    std::vector<MdecCommandImage> images;
+    size_t quant_commands = 0;
+    size_t scale_commands = 0;
+    size_t other_commands = 0; // 0 and 4-7, which take no parameters and do nothing
+    bool truncated = false;    // the last command's parameters run past the end
+};
+
+// Walk every command in [words, words + count) once without copying the RLE data, starting
+// from quant (e.g. the standard tables) until the first set-quant. The words must outlive
+// stream. Each image records the settings in effect when it ran, so they can be decoded in any
+// order or in parallel.
+void parse_mdec_command_stream(const uint16_t *words, size_t count, const MdecQuantTables *quant,
+                               MdecCommandStream &stream);
+
+// Decode one image into width * height * 3 bytes of RGB24 with its tables and output depth:
+// 24-bit as decoded, 15-bit reduced to 5 bits per channel, and the monochrome depths (see
+// decode_mdec_mono_frame) as grey, reduced to 4 bits for 4-bit. The IDCT always uses the
+// standard scale table. Returns the macroblocks (colour) or blocks (monochrome) decoded.
+size_t decode_mdec_command_image(MdecContext &ctx, const MdecCommandImage &image, int width, int height,
+                                 uint8_t *rgb);
@@ -0,0 +1,567 @@
+#include "decode_server.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define MDEC_HAVE_UNIX_SOCKETS 1
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // not on macOS; the server ignores SIGPIPE there too
+#endif
+#endif
+
+#include "batch.h"
+#include "dimensions.h"
+#include "trace.h"
+
+static_assert(sizeof(DecodeRequestHeader) == 48, "request header layout is part of the protocol");
+static_assert(sizeof(DecodeResponseHeader) == 56, "response header layout is part of the protocol");
+
+// Upper bounds on request fields, so a corrupt header cannot make the server allocate gigabytes
+static const uint32_t max_path_length = 4096;
+static const uint64_t max_payload_bytes = 256u << 20;
+static const int32_t max_dimension = 8192;
+
+#ifdef MDEC_HAVE_UNIX_SOCKETS
+
+using Clock = std::chrono::steady_clock;
+
+static uint64_t elapsed_us(Clock::time_point start)
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+// Read exactly bytes; false on EOF or error
+static bool recv_all(int fd, void *buffer, size_t bytes)
+{
+    uint8_t *p = (uint8_t *)buffer;
+    while (bytes > 0)
+    {
+        ssize_t n = recv(fd, p, bytes, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        bytes -= (size_t)n;
+    }
+    return true;
+}
+
+static bool send_all(int fd, const void *buffer, size_t bytes)
+{
+    const uint8_t *p = (const uint8_t *)buffer;
+    while (bytes > 0)
+    {
+        ssize_t n = send(fd, p, bytes, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        bytes -= (size_t)n;
+    }
+    return true;
+}
+
+// Set from signal handlers and worker threads; lock-free, so safe in both
+static std::atomic<bool> stop_signal{false};
+
+static void handle_stop_signal(int)
+{
+    stop_signal = true;
+}
+
+// A connection with a request waiting to be read
+struct ReadyConnection
+{
+    int fd;
+    Clock::time_point ready;
+};
+
+// Readable connections waiting for a worker
+class ConnectionQueue
+{
+public:
+    void push(ReadyConnection connection)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(connection);
+        }
+        ready_.notify_one();
+    }
+
+    // Blocks until a connection arrives; false once closed and drained
+    bool pop(ReadyConnection &connection)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [&]()
+                    { return !queue_.empty() || closed_; });
+        if (queue_.empty())
+            return false;
+        connection = queue_.front();
+        queue_.pop_front();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        ready_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<ReadyConnection> queue_;
+    bool closed_ = false;
+};
+
+// Connections handed back by workers after a request, and a pipe that wakes the poller
+// to watch them again
+class ReturnedConnections
+{
+public:
+    // Both ends non-blocking: take() drains without blocking, and a full pipe already
+    // guarantees a wake-up
+    bool open()
+    {
+        if (pipe(wake_) != 0)
+            return false;
+        fcntl(wake_[0], F_SETFL, O_NONBLOCK);
+        fcntl(wake_[1], F_SETFL, O_NONBLOCK);
+        return true;
+    }
+
+    ~ReturnedConnections()
+    {
+        if (wake_[0] >= 0)
+        {
+            close(wake_[0]);
+            close(wake_[1]);
+        }
+    }
+
+    int wake_fd() const { return wake_[0]; }
+
+    void give_back(int fd)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            fds_.push_back(fd);
+        }
+        char byte = 0;
+        while (write(wake_[1], &byte, 1) < 0 && errno == EINTR)
+        {
+        }
+    }
+
+    void take(std::vector<int> &fds)
+    {
+        char buffer[64];
+        while (read(wake_[0], buffer, sizeof(buffer)) > 0)
+        {
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        fds.insert(fds.end(), fds_.begin(), fds_.end());
+        fds_.clear();
+    }
+
+private:
+    int wake_[2] = {-1, -1};
+    std::mutex mutex_;
+    std::vector<int> fds_;
+};
+
+// Decode worker.words straight into a shared-memory object the client created
+static bool decode_to_shared_memory(ConvertWorker &worker, const DecodeRequestHeader &request,
+                                    const std::string &name, std::string &message)
+{
+    if (request.pixel_format > MDEC_PIXEL_FORMAT_BGRA32)
+    {
+        message = "invalid pixel format";
+        return false;
+    }
+    MdecPixelFormat format = (MdecPixelFormat)request.pixel_format;
+    size_t stride = request.stride ? request.stride : (size_t)worker.width * mdec_pixel_size(format);
+    if (stride < (size_t)worker.width * mdec_pixel_size(format))
+    {
+        message = "stride is smaller than a row";
+        return false;
+    }
+
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        message = "cannot open shared memory " + name;
+        return false;
+    }
+    struct stat st;
+    size_t bytes = stride * worker.height;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= bytes)
+        map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        message = "shared memory " + name + " is smaller than " + std::to_string(bytes) + " bytes";
+        return false;
+    }
+
+    uint16_t *data = worker.words.data();
+    worker.macroblocks = decode_mdec_frame(worker.ctx, &data, data + worker.words.size(), worker.width,
+                                           worker.height, (uint8_t *)map, stride, format);
+    munmap(map, bytes);
+    return true;
+}
+
+// Run one request on a worker's warm buffers
+static bool process_request(ConvertWorker &worker, const DecodeServerOptions &options,
+                            const DecodeRequestHeader &request, const std::string &input, const std::string &output,
+                            std::string &message)
+{
+    ConvertJob job;
+    job.input = request.flags & DECODE_REQUEST_INLINE ? "<inline>" : input;
+    job.width = request.width;
+    job.height = request.height;
+    job.output = output;
+    job.quant = options.quant;
+
+    // Files go through the same path as the command line, output cache included
+    if (!(request.flags & DECODE_REQUEST_SHM) && !output.empty())
+    {
+        bool ok = request.flags & DECODE_REQUEST_INLINE ? convert_words(worker, job, options.png, options.cache)
+                                                         : convert_file(worker, job, options.png, options.cache);
+        if (!ok)
+            message = "could not convert " + job.input + " to " + output;
+        return ok;
+    }
+
+    if (!(request.flags & DECODE_REQUEST_INLINE) && !read_mdec_file(input.c_str(), worker.words))
+    {
+        message = "could not read " + input;
+        return false;
+    }
+    worker.width = request.width;
+    worker.height = request.height;
+    worker.macroblocks = 0;
+    if ((worker.width <= 0 || worker.height <= 0) &&
+        !infer_mdec_size(worker.words.data(), worker.words.data() + worker.words.size(), worker.width, worker.height))
+    {
+        message = "could not infer the size of " + job.input;
+        return false;
+    }
+
+    if (request.flags & DECODE_REQUEST_SHM)
+        return decode_to_shared_memory(worker, request, output, message);
+
+    // Decode only
+    worker.image.resize((size_t)worker.width * worker.height * 3);
+    uint16_t *data = worker.words.data();
+    worker.macroblocks = decode_mdec_frame(worker.ctx, &data, data + worker.words.size(), worker.width,
+                                           worker.height, worker.image.data());
+    return true;
+}
+
+// Answer one request on a readable connection. Returns false once the connection should be
+// closed (client hung up, malformed request).
+static bool serve_request(ConvertWorker &worker, const DecodeServerOptions &options,
+                          const ReadyConnection &connection, std::string &input, std::string &output)
+{
+    uint64_t queue_us = elapsed_us(connection.ready);
+    DecodeRequestHeader request;
+    if (!recv_all(connection.fd, &request, sizeof(request)))
+        return false;
+    Clock::time_point start = Clock::now();
+
+    DecodeResponseHeader response;
+    std::string message;
+    if (request.magic != MDEC_SERVER_REQUEST_MAGIC || request.version != MDEC_SERVER_VERSION ||
+        request.input_length > max_path_length || request.output_length > max_path_length ||
+        request.payload_bytes > max_payload_bytes || request.payload_bytes % 2 != 0 ||
+        request.width > max_dimension || request.height > max_dimension ||
+        request.stride > (uint64_t)max_dimension * 4)
+    {
+        // The rest of the stream cannot be trusted, so answer and hang up
+        message = "malformed request";
+        response.status = 1;
+        response.message_length = (uint32_t)message.size();
+        send_all(connection.fd, &response, sizeof(response));
+        send_all(connection.fd, message.data(), message.size());
+        return false;
+    }
+
+    input.resize(request.input_length);
+    output.resize(request.output_length);
+    bool received = recv_all(connection.fd, input.data(), input.size()) &&
+                    recv_all(connection.fd, output.data(), output.size());
+    if (received && (request.flags & DECODE_REQUEST_INLINE))
+    {
+        worker.words.resize(request.payload_bytes / 2);
+        received = recv_all(connection.fd, worker.words.data(), request.payload_bytes);
+    }
+    if (!received)
+        return false;
+
+    Clock::time_point decode_start = Clock::now();
+    bool ok;
+    try
+    {
+        TraceScope trace("request");
+        ok = process_request(worker, options, request, input, output, message);
+    }
+    catch (const std::bad_alloc &)
+    {
+        // Answer rather than let the exception end the whole server
+        message = "out of memory";
+        ok = false;
+    }
+    response.decode_us = elapsed_us(decode_start);
+    response.status = ok ? 0 : 1;
+    response.width = worker.width;
+    response.height = worker.height;
+    response.macroblocks = worker.macroblocks;
+    response.queue_us = queue_us;
+    response.message_length = (uint32_t)message.size();
+    response.total_us = elapsed_us(start);
+    if (!send_all(connection.fd, &response, sizeof(response)) ||
+        !send_all(connection.fd, message.data(), message.size()))
+        return false;
+
+    if (request.flags & DECODE_REQUEST_SHUTDOWN)
+        stop_signal = true;
+    return true;
+}
+
+bool run_decode_server(const DecodeServerOptions &options)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (options.socket_path.empty() || options.socket_path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Error: Socket path must be 1 to " << sizeof(address.sun_path) - 1 << " bytes" << std::endl;
+        return false;
+    }
+    memcpy(address.sun_path, options.socket_path.c_str(), options.socket_path.size() + 1);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+    {
+        std::cerr << "Error: Could not create socket" << std::endl;
+        return false;
+    }
+
+    // Replace a socket left behind by a server that did not shut down cleanly
+    struct stat st;
+    if (stat(options.socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(options.socket_path.c_str());
+    if (bind(listen_fd, (sockaddr *)&address, sizeof(address)) != 0 || listen(listen_fd, 128) != 0)
+    {
+        std::cerr << "Error: Could not listen on " << options.socket_path << ": " << strerror(errno) << std::endl;
+        close(listen_fd);
+        return false;
+    }
+
+    stop_signal = false;
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+    signal(SIGPIPE, SIG_IGN); // a client hanging up mid-response is handled as a send error
+
+    int thread_count = options.threads > 0 ? options.threads : (int)std::thread::hardware_concurrency();
+    thread_count = std::max(1, thread_count);
+    std::atomic<uint64_t> requests{0};
+    uint64_t connections = 0;
+
+    ReturnedConnections returned;
+    if (!returned.open())
+    {
+        std::cerr << "Error: Could not create wake-up pipe" << std::endl;
+        close(listen_fd);
+        return false;
+    }
+
+    // Workers take one request at a time from any readable connection, so clients are served
+    // fairly however many connect. Contexts and buffers are allocated before the first request.
+    ConnectionQueue queue;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < thread_count; t++)
+    {
+        workers.emplace_back([&, t]()
+                             {
+            trace_thread_name(("worker " + std::to_string(t)).c_str());
+            ConvertWorker worker;
+            worker.ctx.quant = options.quant;
+            if (options.macroblock_cache)
+                worker.ctx.macroblock_cache = std::make_unique<MacroblockCache>();
+            worker.words.reserve(128 * 1024);
+            worker.image.reserve(640 * 480 * 3);
+            std::string input;
+            std::string output;
+            ReadyConnection connection;
+            while (queue.pop(connection))
+            {
+                requests++;
+                if (serve_request(worker, options, connection, input, output) && !stop_signal)
+                    returned.give_back(connection.fd);
+                else
+                    close(connection.fd);
+            } });
+    }
+
+    printf("Listening on %s with %d workers\n", options.socket_path.c_str(), thread_count);
+    fflush(stdout);
+
+    // Watch the listening socket and every idle connection; a connection is not watched
+    // while a worker has it
+    std::vector<int> idle;
+    std::vector<pollfd> pfds;
+    while (!stop_signal)
+    {
+        pfds.clear();
+        pfds.push_back({listen_fd, POLLIN, 0});
+        pfds.push_back({returned.wake_fd(), POLLIN, 0});
+        for (int fd : idle)
+            pfds.push_back({fd, POLLIN, 0});
+        if (poll(pfds.data(), pfds.size(), 200) <= 0)
+            continue;
+
+        Clock::time_point now = Clock::now();
+        std::vector<int> still_idle;
+        for (size_t i = 2; i < pfds.size(); i++)
+        {
+            if (pfds[i].revents)
+                queue.push({pfds[i].fd, now}); // a worker sees a hang-up as a failed read
+            else
+                still_idle.push_back(pfds[i].fd);
+        }
+        idle.swap(still_idle);
+        if (pfds[1].revents)
+            returned.take(idle);
+        if (pfds[0].revents)
+        {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd >= 0)
+            {
+                // A request that starts but stops arriving fails its read after the timeout
+                timeval timeout = {options.io_timeout_ms / 1000, (options.io_timeout_ms % 1000) * 1000};
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                idle.push_back(fd);
+                connections++;
+            }
+        }
+    }
+
+    // Workers answer the requests already queued, then close their connections
+    queue.close();
+    for (std::thread &w : workers)
+        w.join();
+    returned.take(idle);
+    for (int fd : idle)
+        close(fd);
+    close(listen_fd);
+    unlink(options.socket_path.c_str());
+    printf("Served %llu requests on %llu connections\n", (unsigned long long)requests.load(),
+           (unsigned long long)connections);
+    return true;
+}
+
+DecodeClient::~DecodeClient()
+{
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+bool DecodeClient::connect(const std::string &socket_path, std::string &error)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path))
+    {
+        error = "socket path too long";
+        return false;
+    }
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0 || ::connect(fd_, (sockaddr *)&address, sizeof(address)) != 0)
+    {
+        error = "could not connect to " + socket_path + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool DecodeClient::decode(DecodeRequestHeader request, const std::string &input, const std::string &output,
+                          const void *payload, DecodeResponseHeader &response, std::string &message,
+                          std::string &error)
+{
+    request.input_length = (uint32_t)input.size();
+    request.output_length = (uint32_t)output.size();
+    if (!(request.flags & DECODE_REQUEST_INLINE))
+        request.payload_bytes = 0;
+    // The server answers a malformed header and hangs up without reading the rest, so read
+    // its response even if sending failed
+    bool sent = send_all(fd_, &request, sizeof(request)) && send_all(fd_, input.data(), input.size()) &&
+                send_all(fd_, output.data(), output.size()) && send_all(fd_, payload, request.payload_bytes);
+    if (!recv_all(fd_, &response, sizeof(response)) || response.magic != MDEC_SERVER_RESPONSE_MAGIC ||
+        response.message_length > max_path_length * 4)
+    {
+        error = sent ? "no valid response from server" : "could not send request";
+        return false;
+    }
+    message.resize(response.message_length);
+    if (!recv_all(fd_, message.data(), message.size()))
+    {
+        error = "response truncated";
+        return false;
+    }
+    return true;
+}
+
+#else
+
+bool run_decode_server(const DecodeServerOptions &)
+{
+    std::cerr << "Error: The decode server needs Unix domain sockets" << std::endl;
+    return false;
+}
+
+DecodeClient::~DecodeClient() {}
+
+bool DecodeClient::connect(const std::string &, std::string &error)
+{
+    error = "Unix domain sockets are not available";
+    return false;
+}
+
+bool DecodeClient::decode(DecodeRequestHeader, const std::string &, const std::string &, const void *,
+                          DecodeResponseHeader &, std::string &, std::string &error)
+{
+    error = "Unix domain sockets are not available";
+    return false;
+}
+
+#endif
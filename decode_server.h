@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "image_writer.h"
+#include "output_cache.h"
+
+// Decode server protocol over a Unix domain socket, in host byte order. A client sends a
+// DecodeRequestHeader followed by input_length bytes of input path, output_length bytes of
+// output path (or shared-memory object name) and payload_bytes of RLE words, and receives a
+// DecodeResponseHeader followed by message_length bytes of text. Any number of requests may
+// be sent on one connection, one at a time.
+#define MDEC_SERVER_REQUEST_MAGIC 0x5152444d  // "MDRQ"
+#define MDEC_SERVER_RESPONSE_MAGIC 0x5352444d // "MDRS"
+#define MDEC_SERVER_VERSION 1
+
+enum DecodeRequestFlags
+{
+    DECODE_REQUEST_INLINE = 0x1,  // the RLE words follow the paths instead of being read from input
+    DECODE_REQUEST_SHM = 0x2,     // output names a POSIX shared-memory object to decode into
+    DECODE_REQUEST_SHUTDOWN = 0x4 // stop the server once this request is answered
+};
+
+struct DecodeRequestHeader
+{
+    uint32_t magic = MDEC_SERVER_REQUEST_MAGIC;
+    uint32_t version = MDEC_SERVER_VERSION;
+    uint32_t flags = 0;
+    int32_t width = 0; // 0 = infer from the stream
+    int32_t height = 0;
+    uint32_t pixel_format = 0; // MdecPixelFormat of a shared-memory destination
+    uint64_t stride = 0;       // row bytes of a shared-memory destination, 0 = packed
+    uint32_t input_length = 0;
+    uint32_t output_length = 0; // empty = decode only, e.g. for load tests
+    uint64_t payload_bytes = 0;
+};
+
+struct DecodeResponseHeader
+{
+    uint32_t magic = MDEC_SERVER_RESPONSE_MAGIC;
+    int32_t status = 0; // 0 = success, otherwise the message says what failed
+    int32_t width = 0;  // as decoded, after inference
+    int32_t height = 0;
+    uint64_t macroblocks = 0;
+    uint64_t queue_us = 0;  // connection waiting for a free worker
+    uint64_t decode_us = 0; // read, decode and write
+    uint64_t total_us = 0;  // from the request header arriving to the response
+    uint32_t message_length = 0;
+    uint32_t reserved = 0;
+};
+
+struct DecodeServerOptions
+{
+    std::string socket_path;
+    int threads = 0; // 0 = one per hardware thread
+    PngOptions png;
+    bool macroblock_cache = false;
+    OutputCache *cache = nullptr;
+    const MdecQuantTables *quant = mdec_default_quant_tables();
+    // A worker gives up on a connection that sends or takes no bytes for this long, so stalled
+    // clients cannot hold every worker
+    int io_timeout_ms = 1000;
+};
+
+// Serve requests until SIGINT, SIGTERM or a shutdown request. Each worker thread owns a
+// decoder context and buffers allocated up front and serves one connection at a time, so
+// open several connections to decode in parallel. Returns false if the socket cannot be
+// created; not available on platforms without Unix domain sockets.
+bool run_decode_server(const DecodeServerOptions &options);
+
+// One connection to a decode server
+class DecodeClient
+{
+public:
+    DecodeClient() = default;
+    DecodeClient(const DecodeClient &) = delete;
+    DecodeClient &operator=(const DecodeClient &) = delete;
+    ~DecodeClient();
+
+    bool connect(const std::string &socket_path, std::string &error);
+
+    // Send one request and wait for its response. payload holds request.payload_bytes bytes
+    // when DECODE_REQUEST_INLINE is set. Returns false on connection errors only; a failed
+    // decode is reported through response.status and message.
+    bool decode(DecodeRequestHeader request, const std::string &input, const std::string &output,
+                const void *payload, DecodeResponseHeader &response, std::string &message, std::string &error);
+
+private:
+    int fd_ = -1;
+};
@@ -0,0 +1,94 @@
+#include "dimensions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "mdec.h"
+
+// Block DCs of one macroblock: Cr, Cb, then Y0 (top left), Y1 (top right), Y2, Y3
+struct MacroblockDc
+{
+    int16_t dc[6];
+};
+
+static int16_t sign_extend_10bits(uint16_t val)
+{
+    return (int16_t)(val & 0x200 ? (val & 0x3ff) - 0x400 : val & 0x3ff);
+}
+
+// Header DCs of every complete macroblock, found with the same walk as skip_mdec_block
+static void collect_macroblock_dcs(const uint16_t *data, const uint16_t *end, std::vector<MacroblockDc> &dcs)
+{
+    uint16_t *p = const_cast<uint16_t *>(data); // only read
+    uint16_t *stop = const_cast<uint16_t *>(end);
+    while (true)
+    {
+        MacroblockDc mb;
+        for (int blk = 0; blk < 6; blk++)
+        {
+            const uint16_t *header = p;
+            while (header < end && *header == 0xfe00)
+                header++;
+            if (header >= end || !skip_mdec_block(&p, stop))
+                return;
+            mb.dc[blk] = sign_extend_10bits(*header);
+        }
+        dcs.push_back(mb);
+    }
+}
+
+// Mean absolute DC difference between each macroblock and its right-hand neighbour, for
+// macroblocks stored column-major in columns of rows
+static double column_boundary_score(const std::vector<MacroblockDc> &dcs, size_t columns, size_t rows)
+{
+    uint64_t total = 0;
+    for (size_t column = 0; column + 1 < columns; column++)
+    {
+        for (size_t row = 0; row < rows; row++)
+        {
+            const int16_t *left = dcs[column * rows + row].dc;
+            const int16_t *right = dcs[(column + 1) * rows + row].dc;
+            total += std::abs(left[0] - right[0]) + std::abs(left[1] - right[1]); // Cr, Cb
+            total += std::abs(left[3] - right[2]) + std::abs(left[5] - right[4]); // Y1|Y0, Y3|Y2
+        }
+    }
+    return (double)total / ((columns - 1) * rows * 4);
+}
+
+std::vector<DimensionCandidate> infer_mdec_dimensions(const uint16_t *data, const uint16_t *end)
+{
+    std::vector<MacroblockDc> dcs;
+    collect_macroblock_dcs(data, end, dcs);
+
+    std::vector<DimensionCandidate> candidates;
+    size_t count = dcs.size();
+    for (size_t columns = 2; columns * 2 <= count; columns++)
+    {
+        if (count % columns != 0)
+            continue;
+        size_t rows = count / columns;
+        if (columns > rows * 4 || rows > columns * 4)
+            continue;
+        candidates.push_back({(int)columns * 16, (int)rows * 16, column_boundary_score(dcs, columns, rows)});
+    }
+
+    // Equal scores (flat images) go to the shape closest to 4:3
+    std::stable_sort(candidates.begin(), candidates.end(), [](const DimensionCandidate &a, const DimensionCandidate &b)
+                     {
+        if (a.score != b.score)
+            return a.score < b.score;
+        return std::abs(std::log((double)a.width / a.height * 3 / 4)) <
+               std::abs(std::log((double)b.width / b.height * 3 / 4)); });
+    return candidates;
+}
+
+bool infer_mdec_size(const uint16_t *data, const uint16_t *end, int &width, int &height)
+{
+    std::vector<DimensionCandidate> candidates = infer_mdec_dimensions(data, end);
+    if (candidates.empty())
+        return false;
+    width = candidates[0].width;
+    height = candidates[0].height;
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A possible frame size for a stream of macroblocks
+struct DimensionCandidate
+{
+    int width = 0;
+    int height = 0;
+    double score = 0; // mean DC step across macroblock column boundaries; lower is smoother
+};
+
+// Rank the sizes a single frame in [data, end) could have, best first. Macroblocks are counted
+// with the block-boundary scan and each factorisation of the count into at least two columns
+// and rows (aspect ratio within 4:1) is scored by how continuous the DC coefficients are between
+// horizontally neighbouring macroblocks. The right size puts true neighbours side by side; a
+// wrong one pairs macroblocks from unrelated parts of the image. Nothing is decoded.
+// Sizes are multiples of 16, since cropping is not recorded in the stream.
+std::vector<DimensionCandidate> infer_mdec_dimensions(const uint16_t *data, const uint16_t *end);
+
+// Best candidate; false if the stream holds too few macroblocks to tell
+bool infer_mdec_size(const uint16_t *data, const uint16_t *end, int &width, int &height);
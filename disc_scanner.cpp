@@ -0,0 +1,527 @@
+#include "disc_scanner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MDEC_HAVE_SSE2 1
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MDEC_HAVE_MMAP 1
+#endif
+
+#include "mdec.h"
+#include "trace.h"
+
+static const size_t raw_sector_size = 2352;
+static const size_t cooked_sector_size = 2048;
+static const uint8_t sync_pattern[12] = {0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00};
+
+// STR video sectors start with a 32-byte header, followed by 2016 bytes of frame data
+static const size_t str_header_size = 32;
+static const size_t str_payload_size = cooked_sector_size - str_header_size;
+
+// A sector needs this many 0xfe00 words to be parsed. Every block of a real stream ends in one
+// and is at most 65 words long, so MDEC data has at least 15 per 2048 bytes; random data has
+// one in 65536 words.
+static const size_t hot_threshold = 8;
+
+// Longest run of 0xfe00 padding accepted between two macroblocks of one stream
+static const size_t max_padding_words = 1024;
+
+// Macroblocks trial-decoded per candidate
+static const size_t trial_macroblocks = 64;
+
+DiscImage::~DiscImage()
+{
+#ifdef MDEC_HAVE_MMAP
+    if (mapped_)
+        munmap((void *)data_, size_);
+#endif
+}
+
+bool DiscImage::open(const char *path, std::string &error)
+{
+#ifdef MDEC_HAVE_MMAP
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        error = std::string("cannot stat ") + path;
+        return false;
+    }
+    size_ = (size_t)st.st_size;
+    if (size_ > 0)
+    {
+        void *map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            close(fd);
+            error = std::string("cannot map ") + path;
+            return false;
+        }
+        madvise(map, size_, MADV_SEQUENTIAL);
+        data_ = (const uint8_t *)map;
+        mapped_ = true;
+    }
+    close(fd);
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+    buffer_.resize((size_t)file.tellg());
+    file.seekg(0, std::ios::beg);
+    if (!file.read((char *)buffer_.data(), buffer_.size()))
+    {
+        error = std::string("cannot read ") + path;
+        return false;
+    }
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+
+    // Raw if most of a sample of sectors carry the sync pattern, so that a damaged or
+    // blank first sector does not turn the whole image into misaligned 2048-byte chunks
+    raw_ = false;
+    if (size_ >= raw_sector_size && size_ % raw_sector_size == 0)
+    {
+        size_t sectors = size_ / raw_sector_size;
+        size_t samples = std::min<size_t>(sectors, 16);
+        size_t synced = 0;
+        for (size_t i = 0; i < samples; i++)
+            synced += memcmp(data_ + (i * sectors / samples) * raw_sector_size, sync_pattern, sizeof(sync_pattern)) == 0;
+        raw_ = synced * 2 > samples;
+    }
+    return true;
+}
+
+size_t DiscImage::sector_count() const
+{
+    if (raw_)
+        return size_ / raw_sector_size;
+    return (size_ + cooked_sector_size - 1) / cooked_sector_size;
+}
+
+const uint8_t *DiscImage::user_data(size_t sector, size_t &bytes) const
+{
+    if (!raw_)
+    {
+        size_t offset = sector * cooked_sector_size;
+        bytes = std::min(cooked_sector_size, size_ - offset);
+        return data_ + offset;
+    }
+
+    const uint8_t *s = data_ + sector * raw_sector_size;
+    if (s[15] != 2) // Mode 1 (or anything not Mode 2)
+    {
+        bytes = cooked_sector_size;
+        return s + 16;
+    }
+    bytes = (s[18] & 0x20) ? 2324 : cooked_sector_size; // subheader submode Form 2 bit
+    return s + 24;
+}
+
+uint64_t DiscImage::user_data_offset(size_t sector) const
+{
+    size_t bytes;
+    return (uint64_t)(user_data(sector, bytes) - data_);
+}
+
+static uint16_t load_word(const uint8_t *p)
+{
+    uint16_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+static uint32_t load_dword(const uint8_t *p)
+{
+    uint32_t d;
+    memcpy(&d, p, sizeof(d));
+    return d;
+}
+
+// Number of 0xfe00 words at even offsets
+static size_t count_end_of_block_words(const uint8_t *data, size_t bytes)
+{
+    size_t count = 0;
+    size_t i = 0;
+#ifdef MDEC_HAVE_SSE2
+    const __m128i marker = _mm_set1_epi16((short)0xfe00);
+    size_t matched_bytes = 0;
+    for (; i + 16 <= bytes; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        matched_bytes += std::popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi16(v, marker)));
+    }
+    count = matched_bytes / 2;
+#endif
+    for (; i + 2 <= bytes; i += 2)
+        count += load_word(data + i) == 0xfe00;
+    return count;
+}
+
+enum SectorKind : uint8_t
+{
+    SECTOR_OTHER = 0, // Form 2 audio and anything else that is not searched
+    SECTOR_DATA,      // 2048 bytes of file data with too few 0xfe00 words to hold MDEC data
+    SECTOR_HOT,       // file data dense enough in 0xfe00 words to be parsed
+    SECTOR_STR        // STR video
+};
+
+static bool is_str_video_sector(const uint8_t *data, size_t bytes)
+{
+    return bytes == cooked_sector_size && load_word(data) == 0x0160 && load_word(data + 2) == 0x8001;
+}
+
+static SectorKind classify_sector(const DiscImage &image, size_t sector)
+{
+    size_t bytes;
+    const uint8_t *data = image.user_data(sector, bytes);
+    if (is_str_video_sector(data, bytes))
+        return SECTOR_STR;
+    if (bytes > cooked_sector_size)
+        return SECTOR_OTHER;
+    return count_end_of_block_words(data, bytes) >= hot_threshold ? SECTOR_HOT : SECTOR_DATA;
+}
+
+// Consume one block starting at its header word, requiring the exact structure rle_decode
+// expects: a nonzero q_scale, AC runs that stay inside the block and a 0xfe00 terminator,
+// which may be missing after coefficient 63 (the hardware reads it, rle_decode skips it).
+static bool parse_block(const uint16_t *&p, const uint16_t *end, int &q_scale)
+{
+    q_scale = *p++ >> 10;
+    if (q_scale == 0)
+        return false;
+
+    int k = 1;
+    while (p < end)
+    {
+        uint16_t n = *p++;
+        if (n == 0xfe00)
+            return true;
+        k += n >> 10;
+        if (k > 63)
+            return false;
+        if (++k == 64)
+        {
+            if (p < end && *p == 0xfe00)
+                p++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Longest run of whole macroblocks from start whose blocks all parse and share one q_scale.
+// Padding is allowed between macroblocks but never counted into the stream.
+static size_t parse_stream(const uint16_t *start, const uint16_t *end, const uint16_t *&stream_end, int &q_scale)
+{
+    const uint16_t *p = start;
+    size_t blocks = 0;
+    q_scale = -1;
+    stream_end = start;
+    while (p < end)
+    {
+        if (blocks % 6 == 0 && blocks > 0)
+        {
+            const uint16_t *padding = p;
+            while (p < end && *p == 0xfe00 && (size_t)(p - padding) <= max_padding_words)
+                p++;
+            if (p >= end || *p == 0xfe00)
+                break;
+        }
+
+        int block_q_scale;
+        if (*p == 0xfe00 || !parse_block(p, end, block_q_scale) || (q_scale >= 0 && block_q_scale != q_scale))
+            break;
+        q_scale = block_q_scale;
+        if (++blocks % 6 == 0)
+            stream_end = p;
+    }
+    return blocks / 6;
+}
+
+// Decode the first macroblocks as a 16-pixel wide column and reject noise: neighbouring pixels
+// of real images are close, while structurally valid garbage decodes to random colours
+static bool trial_decode(MdecContext &ctx, uint16_t *start, uint16_t *end, size_t macroblocks,
+                         std::vector<uint8_t> &pixels)
+{
+    size_t count = std::min(macroblocks, trial_macroblocks);
+    uint16_t *trial_end = start;
+    skip_mdec_macroblocks(&trial_end, end, count);
+
+    int height = (int)count * 16;
+    pixels.assign((size_t)16 * height * 3, 0);
+    uint16_t *p = start;
+    if (decode_mdec_frame(ctx, &p, trial_end, 16, height, pixels.data()) != count)
+        return false;
+
+    uint64_t gradient = 0;
+    for (int y = 0; y < height; y++)
+        for (int x = 1; x < 16; x++)
+        {
+            const uint8_t *px = pixels.data() + ((size_t)y * 16 + x) * 3 + 1; // green
+            gradient += std::abs(px[0] - px[-3]);
+        }
+    return gradient < (uint64_t)height * 15 * 48;
+}
+
+// A maximal run of searchable sectors holding at least one hot sector
+struct ScanRegion
+{
+    size_t first; // index into the data sector list
+    size_t last;  // exclusive
+};
+
+static void scan_region(const DiscImage &image, const std::vector<uint32_t> &data_sectors, const ScanRegion &region,
+                        size_t min_macroblocks, MdecContext &ctx, std::vector<DiscAsset> &assets)
+{
+    // Gather the sectors into one word buffer, remembering where each begins. Only the last
+    // sector of a cooked image can have an odd length, and its final byte is never a word.
+    std::vector<size_t> sector_starts;
+    std::vector<uint16_t> words;
+    size_t total = 0;
+    for (size_t i = region.first; i < region.last; i++)
+    {
+        size_t length;
+        image.user_data(data_sectors[i], length);
+        sector_starts.push_back(total);
+        total += length;
+    }
+    words.resize(total / 2);
+    for (size_t i = region.first; i < region.last; i++)
+    {
+        size_t length;
+        const uint8_t *data = image.user_data(data_sectors[i], length);
+        size_t offset = sector_starts[i - region.first];
+        memcpy((uint8_t *)words.data() + offset, data, std::min(length, words.size() * 2 - offset));
+    }
+
+    uint16_t *end = words.data() + words.size();
+    std::vector<uint8_t> pixels;
+    for (uint16_t *p = words.data(); p < end;)
+    {
+        const uint16_t *stream_end;
+        int q_scale;
+        size_t macroblocks = *p == 0xfe00 ? 0 : parse_stream(p, end, stream_end, q_scale);
+        if (macroblocks < min_macroblocks)
+        {
+            p++;
+            continue;
+        }
+
+        // Garbage right before a stream can parse as extra leading blocks and shift every
+        // macroblock boundary, so retry without up to five of them before rejecting the run.
+        // A rejected run is skipped whole; rescanning it word by word would be quadratic.
+        const uint16_t *run_end = stream_end;
+        bool valid = trial_decode(ctx, p, end, macroblocks, pixels);
+        uint16_t *candidate = p;
+        for (int shift = 1; shift < 6 && !valid; shift++)
+        {
+            const uint16_t *next = candidate;
+            int block_q_scale;
+            parse_block(next, end, block_q_scale);
+            candidate = const_cast<uint16_t *>(next);
+            macroblocks = parse_stream(candidate, end, stream_end, q_scale);
+            if (macroblocks < min_macroblocks)
+                break;
+            valid = trial_decode(ctx, candidate, end, macroblocks, pixels);
+        }
+        if (!valid)
+        {
+            p = const_cast<uint16_t *>(run_end);
+            continue;
+        }
+        p = candidate;
+
+        size_t begin_byte = (p - words.data()) * sizeof(uint16_t);
+        size_t end_byte = (stream_end - words.data()) * sizeof(uint16_t);
+        size_t first = std::upper_bound(sector_starts.begin(), sector_starts.end(), begin_byte) - sector_starts.begin() - 1;
+        size_t last = std::upper_bound(sector_starts.begin(), sector_starts.end(), end_byte - 1) - sector_starts.begin();
+
+        DiscAsset asset;
+        asset.type = DISC_ASSET_MDEC;
+        asset.start = begin_byte - sector_starts[first];
+        asset.bytes = end_byte - begin_byte;
+        asset.file_offset = image.user_data_offset(data_sectors[region.first + first]) + asset.start;
+        asset.sectors.assign(data_sectors.begin() + region.first + first, data_sectors.begin() + region.first + last);
+        asset.macroblocks = macroblocks;
+        asset.q_scale = q_scale;
+        assets.push_back(std::move(asset));
+        p = const_cast<uint16_t *>(stream_end);
+    }
+}
+
+// Group STR video sectors into frames. Sectors of one frame are consecutive apart from
+// interleaved audio; a frame missing any of its sectors is dropped.
+static void collect_str_frames(const DiscImage &image, const std::vector<uint32_t> &str_sectors,
+                               std::vector<DiscAsset> &assets)
+{
+    DiscAsset pending;
+    size_t filled = 0;
+    auto flush = [&]()
+    {
+        if (filled > 0 && filled == pending.sectors.size())
+        {
+            pending.file_offset = image.user_data_offset(pending.sectors[0]) + str_header_size;
+            assets.push_back(pending);
+        }
+        pending.sectors.clear();
+        filled = 0;
+    };
+
+    for (uint32_t sector : str_sectors)
+    {
+        size_t length;
+        const uint8_t *h = image.user_data(sector, length);
+        uint16_t index = load_word(h + 4);
+        uint16_t count = load_word(h + 6);
+        uint32_t frame = load_dword(h + 8);
+        uint32_t size = load_dword(h + 12);
+        int width = load_word(h + 16);
+        int height = load_word(h + 18);
+        if (count == 0 || index >= count || width == 0 || height == 0 || size > count * str_payload_size)
+            continue;
+
+        if (filled == 0 || frame != pending.frame || count != pending.sectors.size() || width != pending.width ||
+            height != pending.height || size != pending.bytes)
+        {
+            flush();
+            pending.type = DISC_ASSET_STR_FRAME;
+            pending.frame = frame;
+            pending.width = width;
+            pending.height = height;
+            pending.bytes = size;
+            pending.start = str_header_size;
+            pending.sectors.assign(count, UINT32_MAX);
+        }
+        if (pending.sectors[index] == UINT32_MAX)
+        {
+            pending.sectors[index] = sector;
+            filled++;
+        }
+        if (filled == count)
+            flush();
+    }
+    flush();
+}
+
+std::vector<DiscAsset> scan_disc_image(const DiscImage &image, const DiscScanOptions &options)
+{
+    size_t sector_count = image.sector_count();
+    int thread_count = options.threads > 0 ? options.threads : (int)std::thread::hardware_concurrency();
+    thread_count = std::max(1, thread_count);
+
+    // Classify every sector, in contiguous slices per thread
+    std::vector<SectorKind> kinds(sector_count);
+    {
+        TraceScope trace("classify sectors");
+        std::vector<std::thread> threads;
+        size_t slice = (sector_count + thread_count - 1) / thread_count;
+        for (int t = 0; t < thread_count; t++)
+        {
+            threads.emplace_back([&, t]()
+                                 {
+                size_t first = std::min(sector_count, t * slice);
+                size_t last = std::min(sector_count, first + slice);
+                for (size_t s = first; s < last; s++)
+                    kinds[s] = classify_sector(image, s); });
+        }
+        for (std::thread &t : threads)
+            t.join();
+    }
+
+    // File data is searched as one logical stream across the sectors that can hold it, so
+    // streams spanning interleaved audio sectors stay whole
+    std::vector<uint32_t> data_sectors;
+    std::vector<uint32_t> str_sectors;
+    std::vector<ScanRegion> regions;
+    for (size_t s = 0; s < sector_count; s++)
+    {
+        if (kinds[s] == SECTOR_STR)
+            str_sectors.push_back((uint32_t)s);
+        if (kinds[s] != SECTOR_DATA && kinds[s] != SECTOR_HOT)
+            continue;
+
+        // A hot sector pulls in one neighbour on each side for streams starting or ending there
+        size_t index = data_sectors.size();
+        data_sectors.push_back((uint32_t)s);
+        if (kinds[s] != SECTOR_HOT)
+            continue;
+        size_t first = index > 0 ? index - 1 : 0;
+        if (!regions.empty() && regions.back().last >= first)
+            regions.back().last = index + 2;
+        else
+            regions.push_back({first, index + 2});
+    }
+    for (ScanRegion &region : regions)
+        region.last = std::min(region.last, data_sectors.size());
+
+    // Parse and trial-decode the regions in parallel
+    std::vector<std::vector<DiscAsset>> found(regions.size());
+    {
+        std::atomic<size_t> next_region{0};
+        std::vector<std::thread> threads;
+        int workers = std::max(1, std::min(thread_count, (int)regions.size()));
+        for (int t = 0; t < workers; t++)
+        {
+            threads.emplace_back([&]()
+                                 {
+                MdecContext ctx;
+                for (size_t i = next_region++; i < regions.size(); i = next_region++)
+                {
+                    TraceScope trace("scan region", (int64_t)i);
+                    scan_region(image, data_sectors, regions[i], options.min_macroblocks, ctx, found[i]);
+                } });
+        }
+        for (std::thread &t : threads)
+            t.join();
+    }
+
+    std::vector<DiscAsset> assets;
+    for (std::vector<DiscAsset> &region_assets : found)
+        for (DiscAsset &asset : region_assets)
+            assets.push_back(std::move(asset));
+    if (options.str)
+        collect_str_frames(image, str_sectors, assets);
+
+    std::sort(assets.begin(), assets.end(), [](const DiscAsset &a, const DiscAsset &b)
+              { return a.file_offset < b.file_offset; });
+    return assets;
+}
+
+void read_disc_asset(const DiscImage &image, const DiscAsset &asset, std::vector<uint8_t> &bytes)
+{
+    bytes.clear();
+    bytes.reserve(asset.bytes);
+    for (size_t i = 0; i < asset.sectors.size() && bytes.size() < asset.bytes; i++)
+    {
+        size_t length;
+        const uint8_t *data = image.user_data(asset.sectors[i], length);
+        size_t skip = asset.type == DISC_ASSET_STR_FRAME || i == 0 ? asset.start : 0;
+        size_t take = std::min(length - skip, asset.bytes - bytes.size());
+        bytes.insert(bytes.end(), data + skip, data + skip + take);
+    }
+}
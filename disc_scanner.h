@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only view of a disc image, memory-mapped where the platform allows. Raw images (BIN,
+// 2352-byte sectors starting with the CD sync pattern) are addressed through each sector's
+// user data; anything else (ISO, plain files) is treated as consecutive 2048-byte sectors.
+class DiscImage
+{
+public:
+    DiscImage() = default;
+    DiscImage(const DiscImage &) = delete;
+    DiscImage &operator=(const DiscImage &) = delete;
+    ~DiscImage();
+
+    bool open(const char *path, std::string &error);
+
+    bool raw() const { return raw_; }
+    size_t size() const { return size_; }
+    size_t sector_count() const;
+
+    // User data of a sector: 2048 bytes (Mode 1, Mode 2 Form 1, cooked), 2324 (Mode 2 Form 2)
+    // or less for the last sector of a cooked image
+    const uint8_t *user_data(size_t sector, size_t &bytes) const;
+
+    // Offset of a sector's user data in the image file
+    uint64_t user_data_offset(size_t sector) const;
+
+private:
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+    bool raw_ = false;
+    bool mapped_ = false;
+    std::vector<uint8_t> buffer_; // when memory mapping is unavailable
+};
+
+enum DiscAssetType
+{
+    DISC_ASSET_MDEC = 0,     // raw MDEC RLE words, as read by mdec_decoder
+    DISC_ASSET_STR_FRAME = 1 // demultiplexed STR video frame (BS bitstream, not raw RLE)
+};
+
+struct DiscAsset
+{
+    DiscAssetType type = DISC_ASSET_MDEC;
+    uint64_t file_offset = 0;      // of the first payload byte in the image file
+    std::vector<uint32_t> sectors; // holding the payload, in order
+    size_t start = 0;              // payload offset in the first sector's user data
+    size_t bytes = 0;
+
+    // MDEC streams: whole macroblocks validated, and their common q_scale
+    size_t macroblocks = 0;
+    int q_scale = 0;
+
+    // STR frames, from the sector headers
+    uint32_t frame = 0;
+    int width = 0;
+    int height = 0;
+};
+
+struct DiscScanOptions
+{
+    int threads = 0;            // 0 = all hardware threads
+    size_t min_macroblocks = 16; // shorter MDEC streams are ignored
+    bool str = true;            // also collect STR video frames
+};
+
+// Find every MDEC stream and STR video frame in the image, ordered by file offset.
+// Sectors are screened with a vectorised count of 0xfe00 end-of-block words; dense runs are
+// parsed block by block and confirmed by trial-decoding their first macroblocks.
+std::vector<DiscAsset> scan_disc_image(const DiscImage &image, const DiscScanOptions &options);
+
+// Gather an asset's payload out of its sectors
+void read_disc_asset(const DiscImage &image, const DiscAsset &asset, std::vector<uint8_t> &bytes);
@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image_reader.h"
+#include "mdec.h"
+#include "mdec_encoder.h"
+
+namespace fs = std::filesystem;
+
+// Payload of one STR video sector in 16-bit words
+static const size_t STR_SECTOR_WORDS = 2016 / 2;
+
+static void print_usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " <input.png|.ppm|.rgb> <output.bin> [options]" << std::endl
+              << "       " << program << " <frame_%04d.png> <output.bin> [options]  (frames 0, 1, ... into one stream)" << std::endl
+              << "  --size WxH       dimensions of raw RGB24 input" << std::endl
+              << "  --q-scale N      quantiser scale 1-63 (default 8, higher is smaller and blurrier)" << std::endl
+              << "  --threads N      encoder threads (default: all hardware threads)" << std::endl
+              << "  --budget WORDS   pick the best q_scale per frame that fits WORDS 16-bit words" << std::endl
+              << "  --sectors N      budget of N STR video sectors (2016 bytes each)" << std::endl
+              << "  --pad            fill each frame with 0xfe00 up to the budget" << std::endl
+              << "  --verify         decode the output again and fail if the PSNR is below --min-psnr" << std::endl
+              << "  --min-psnr DB    round-trip threshold for --verify (default 30)" << std::endl;
+}
+
+// PSNR over all RGB samples; infinite for identical images
+static double rgb_psnr(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b)
+{
+    double squared = 0.0;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        double d = (double)a[i] - b[i];
+        squared += d * d;
+    }
+    if (squared == 0.0)
+        return INFINITY;
+    return 10.0 * std::log10(255.0 * 255.0 * a.size() / squared);
+}
+
+// Decode the encoded words with the regular decoder and compare against the source
+static bool verify_round_trip(std::vector<uint16_t> words, int width, int height,
+                              const std::vector<uint8_t> &rgb, double min_psnr)
+{
+    int padded_width = (width + 15) & ~15;
+    int padded_height = (height + 15) & ~15;
+    std::vector<uint8_t> decoded((size_t)padded_width * padded_height * 3);
+
+    MdecContext ctx;
+    uint16_t *data = words.data();
+    size_t macroblocks = decode_mdec_frame(ctx, &data, words.data() + words.size(), padded_width, padded_height,
+                                           decoded.data());
+
+    // Crop the edge padding before comparing
+    std::vector<uint8_t> cropped((size_t)width * height * 3);
+    for (int y = 0; y < height; y++)
+        std::copy_n(&decoded[(size_t)y * padded_width * 3], width * 3, &cropped[(size_t)y * width * 3]);
+
+    double psnr = rgb_psnr(rgb, cropped);
+    bool consumed = data == words.data() + words.size();
+    printf("Round trip: %zu macroblocks, %s, PSNR %.2f dB\n", macroblocks,
+           consumed ? "all words consumed" : "words left over", psnr);
+    return consumed && !ctx.early_terminate && psnr >= min_psnr;
+}
+
+// Encode numbered frames (0, 1, ... until one is missing) into one stream. Frames are handed
+// to workers one at a time, each encoding single-threaded, so a sequence keeps every core busy.
+// With a budget each frame gets its own q_scale from predict_mdec_words, and pad fills frames
+// with 0xfe00 up to the budget so they sit at fixed offsets.
+static bool encode_sequence(const char *pattern, const char *output, const MdecEncodeOptions &options,
+                            int width, int height, bool pad)
+{
+    std::vector<std::string> paths;
+    for (;;)
+    {
+        char buffer[4096];
+        snprintf(buffer, sizeof(buffer), pattern, (int)paths.size());
+        if (!fs::exists(buffer))
+            break;
+        paths.push_back(buffer);
+    }
+    if (paths.empty())
+    {
+        std::cerr << "Error: no frames match " << pattern << std::endl;
+        return false;
+    }
+
+    struct Frame
+    {
+        std::vector<uint16_t> words;
+        MdecEncodeResult result;
+        bool loaded = false;
+    };
+    std::vector<Frame> frames(paths.size());
+
+    MdecEncodeOptions frame_options = options;
+    frame_options.threads = 1;
+    int thread_count = options.threads > 0 ? options.threads : (int)std::thread::hardware_concurrency();
+    thread_count = std::max(1, std::min(thread_count, (int)paths.size()));
+
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; t++)
+    {
+        threads.emplace_back([&]()
+                             {
+                                 std::vector<uint8_t> rgb;
+                                 for (size_t i = next++; i < paths.size(); i = next++)
+                                 {
+                                     int frame_width = width, frame_height = height;
+                                     if (!read_image(paths[i].c_str(), frame_width, frame_height, rgb))
+                                         continue;
+                                     frames[i].result = encode_mdec_image(rgb.data(), frame_width, frame_height,
+                                                                          frame_options, frames[i].words);
+                                     frames[i].loaded = true;
+                                 } });
+    }
+    for (std::thread &t : threads)
+        t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<uint16_t> stream;
+    size_t over_budget = 0, failed = 0, q_total = 0;
+    int q_min = 63, q_max = 1;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        Frame &frame = frames[i];
+        if (!frame.loaded)
+        {
+            failed++;
+            continue;
+        }
+        if (!frame.result.fits)
+        {
+            std::cerr << "Warning: " << paths[i] << " needs " << frame.result.words << " words at q_scale "
+                      << frame.result.q_scale << ", over the budget of " << options.word_budget << std::endl;
+            over_budget++;
+        }
+        q_min = std::min(q_min, frame.result.q_scale);
+        q_max = std::max(q_max, frame.result.q_scale);
+        q_total += frame.result.q_scale;
+
+        stream.insert(stream.end(), frame.words.begin(), frame.words.end());
+        if (pad && options.word_budget > frame.words.size())
+            stream.resize(stream.size() + options.word_budget - frame.words.size(), 0xfe00);
+    }
+
+    if (!write_mdec_file(output, stream))
+        return false;
+    size_t encoded = frames.size() - failed;
+    printf("Encoded %zu frames into %zu words in %.3f s on %d threads (%.1f frames/s), q_scale %d-%d (mean %.1f)\n",
+           encoded, stream.size(), seconds, thread_count, encoded / seconds, q_min, q_max,
+           encoded ? (double)q_total / encoded : 0.0);
+    if (over_budget)
+        printf("%zu frames exceed the budget\n", over_budget);
+    return failed == 0 && over_budget == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<const char *> args;
+    MdecEncodeOptions options;
+    int width = 0, height = 0;
+    bool verify = false;
+    bool pad = false;
+    double min_psnr = 30.0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--size" && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2)
+            {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (arg == "--q-scale" && i + 1 < argc)
+            options.q_scale = std::stoi(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc)
+            options.threads = std::stoi(argv[++i]);
+        else if (arg == "--budget" && i + 1 < argc)
+            options.word_budget = std::stoull(argv[++i]);
+        else if (arg == "--sectors" && i + 1 < argc)
+            options.word_budget = std::stoull(argv[++i]) * STR_SECTOR_WORDS;
+        else if (arg == "--pad")
+            pad = true;
+        else if (arg == "--verify")
+            verify = true;
+        else if (arg == "--min-psnr" && i + 1 < argc)
+            min_psnr = std::stod(argv[++i]);
+        else
+            args.push_back(argv[i]);
+    }
+
+    if (args.size() != 2 || options.q_scale < 1 || options.q_scale > 63)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (strchr(args[0], '%'))
+        return encode_sequence(args[0], args[1], options, width, height, pad) ? 0 : 1;
+
+    std::vector<uint8_t> rgb;
+    if (!read_image(args[0], width, height, rgb))
+        return 1;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint16_t> words;
+    MdecEncodeResult result = encode_mdec_image(rgb.data(), width, height, options, words);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (pad && options.word_budget > words.size())
+        words.resize(options.word_budget, 0xfe00);
+    if (!write_mdec_file(args[1], words))
+        return 1;
+    printf("Encoded %dx%d into %zu macroblocks, %zu words at q_scale %d in %.3f s\n", width, height,
+           result.macroblocks, result.words, result.q_scale, seconds);
+    if (!result.fits)
+    {
+        std::cerr << "Error: " << result.words << " words at q_scale " << result.q_scale << " exceed the budget of "
+                  << options.word_budget << std::endl;
+        return 1;
+    }
+
+    if (verify && !verify_round_trip(words, width, height, rgb, min_psnr))
+    {
+        std::cerr << "Error: round trip below " << min_psnr << " dB" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,317 @@
+#include "frame_ring.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MDEC_HAVE_SHM 1
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring counters must be address-free to be shared");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "ring counters are used as futex words");
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t page_size = 4096;
+static const int close_slice_ms = 50;
+
+static size_t round_up(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static FrameRingSlot *slot_table(FrameRingHeader *header)
+{
+    return (FrameRingSlot *)(header + 1);
+}
+
+// Sleep while counter still holds value, for at most timeout_ms (-1 = until woken). Wakeups
+// may be spurious; callers re-check their condition.
+static void wait_while_equal(std::atomic<uint32_t> &counter, uint32_t value, int timeout_ms)
+{
+#ifdef __linux__
+    // Not FUTEX_PRIVATE_FLAG: the word is shared with another process
+    timespec timeout = {timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000};
+    syscall(SYS_futex, (uint32_t *)&counter, FUTEX_WAIT, value, timeout_ms >= 0 ? &timeout : nullptr, nullptr, 0);
+#else
+    // No portable cross-process wait: poll
+    (void)counter, (void)value, (void)timeout_ms;
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+#endif
+}
+
+static void wake(std::atomic<uint32_t> &counter)
+{
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t *)&counter, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+    (void)counter;
+#endif
+}
+
+// Wait for the other side to move counter away from value. Announcing the wait before the
+// final check, with sequentially consistent stores on both sides, means a change made after
+// that check always sees the flag and wakes us; the futex compare covers the remaining race.
+// Closing does not change the counter, so a consumer also passes closed and sleeps in short
+// slices: a close racing with the final check costs at most one slice.
+static FrameRingStatus wait_for_change(std::atomic<uint32_t> &counter, std::atomic<uint32_t> &waiting,
+                                       uint32_t value, Clock::time_point deadline, bool forever,
+                                       const std::atomic<uint32_t> *closed = nullptr)
+{
+    while (counter.load() == value)
+    {
+        if (closed && closed->load())
+            return counter.load() == value ? FRAME_RING_CLOSED : FRAME_RING_OK;
+        int timeout_ms = -1;
+        if (!forever)
+        {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            if (left <= 0)
+                return FRAME_RING_TIMEOUT;
+            timeout_ms = (int)std::min<long long>(left, INT_MAX);
+        }
+        if (closed && (timeout_ms < 0 || timeout_ms > close_slice_ms))
+            timeout_ms = close_slice_ms;
+        waiting.store(1);
+        if (counter.load() == value)
+            wait_while_equal(counter, value, timeout_ms);
+        waiting.store(0);
+    }
+    return FRAME_RING_OK;
+}
+
+static void notify(std::atomic<uint32_t> &counter, std::atomic<uint32_t> &waiting)
+{
+    if (waiting.load())
+        wake(counter);
+}
+
+FrameRing::~FrameRing()
+{
+#ifdef MDEC_HAVE_SHM
+    if (header_)
+    {
+        if (owner_)
+            close_producer();
+        munmap(header_, size_);
+    }
+    if (owner_)
+        shm_unlink(name_.c_str());
+#endif
+}
+
+// slot_count is a power of two, so a sequence keeps its slot when the 32-bit counters wrap
+uint8_t *FrameRing::slot_pixels(uint32_t sequence) const
+{
+    return (uint8_t *)header_ + header_->data_offset + (sequence & (header_->slot_count - 1)) * header_->slot_bytes;
+}
+
+bool FrameRing::create(const std::string &name, int width, int height, MdecPixelFormat format, uint32_t slots,
+                       std::string &error)
+{
+#ifdef MDEC_HAVE_SHM
+    if (header_ || width <= 0 || height <= 0)
+    {
+        error = "invalid frame ring size";
+        return false;
+    }
+    if (slots == 0 || (slots & (slots - 1)) != 0)
+    {
+        error = "frame ring slot count must be a power of two";
+        return false;
+    }
+    size_t stride = (size_t)width * mdec_pixel_size(format);
+    size_t slot_bytes = round_up(stride * height, page_size);
+    size_t data_offset = round_up(sizeof(FrameRingHeader) + slots * sizeof(FrameRingSlot), page_size);
+    size_t size = data_offset + slots * slot_bytes;
+
+    // A consumer still attached to an object of the same name keeps its old mapping
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 || ftruncate(fd, (off_t)size) != 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            shm_unlink(name.c_str());
+        }
+        error = "cannot create shared memory " + name;
+        return false;
+    }
+    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        shm_unlink(name.c_str());
+        error = "cannot map shared memory " + name;
+        return false;
+    }
+
+    header_ = new (map) FrameRingHeader();
+    header_->width = width;
+    header_->height = height;
+    header_->pixel_format = format;
+    header_->slot_count = slots;
+    header_->stride = stride;
+    header_->slot_bytes = slot_bytes;
+    header_->data_offset = data_offset;
+    header_->head.store(0);
+    header_->tail.store(0);
+    header_->consumer_waiting.store(0);
+    header_->producer_waiting.store(0);
+    header_->closed.store(0);
+    header_->version = MDEC_FRAME_RING_VERSION;
+    // Consumers that find the object before this point see a zero magic and retry
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = MDEC_FRAME_RING_MAGIC;
+
+    size_ = size;
+    name_ = name;
+    owner_ = true;
+    return true;
+#else
+    (void)name, (void)width, (void)height, (void)format, (void)slots;
+    error = "shared memory is not available on this platform";
+    return false;
+#endif
+}
+
+bool FrameRing::open(const std::string &name, std::string &error)
+{
+#ifdef MDEC_HAVE_SHM
+    if (header_)
+    {
+        error = "frame ring already open";
+        return false;
+    }
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        error = "no frame ring named " + name;
+        return false;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= page_size)
+        map = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        error = "cannot map shared memory " + name;
+        return false;
+    }
+
+    FrameRingHeader *header = (FrameRingHeader *)map;
+    size_t size = st.st_size;
+    uint32_t magic = *(volatile uint32_t *)&header->magic;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (magic != MDEC_FRAME_RING_MAGIC || header->version != MDEC_FRAME_RING_VERSION ||
+        header->slot_count == 0 || (header->slot_count & (header->slot_count - 1)) != 0 ||
+        header->data_offset + (uint64_t)header->slot_count * header->slot_bytes > size)
+    {
+        munmap(map, size);
+        error = name + " is not an initialised frame ring";
+        return false;
+    }
+    header_ = header;
+    size_ = size;
+    name_ = name;
+    owner_ = false;
+    return true;
+#else
+    (void)name;
+    error = "shared memory is not available on this platform";
+    return false;
+#endif
+}
+
+FrameRingStatus FrameRing::acquire_write(uint8_t *&pixels, int timeout_ms)
+{
+    auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms > 0 ? timeout_ms : 0);
+    uint32_t head = header_->head.load(std::memory_order_relaxed); // only the producer writes head
+    while (true)
+    {
+        uint32_t tail = header_->tail.load(std::memory_order_acquire);
+        if (head - tail < header_->slot_count)
+            break;
+        if (wait_for_change(header_->tail, header_->producer_waiting, tail, deadline, timeout_ms < 0) !=
+            FRAME_RING_OK)
+            return FRAME_RING_TIMEOUT;
+    }
+    pixels = slot_pixels(head);
+    return FRAME_RING_OK;
+}
+
+void FrameRing::publish(const FrameRingSlot &info)
+{
+    uint32_t head = header_->head.load(std::memory_order_relaxed);
+    FrameRingSlot &slot = slot_table(header_)[head & (header_->slot_count - 1)];
+    slot = info;
+    slot.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    header_->head.store(head + 1); // releases the pixels and the slot entry
+    notify(header_->head, header_->consumer_waiting);
+}
+
+void FrameRing::close_producer()
+{
+    header_->closed.store(1);
+    // Unconditional, so a consumer asleep on head notices without waiting out its slice
+    wake(header_->head);
+}
+
+FrameRingStatus FrameRing::wait_drained(int timeout_ms)
+{
+    auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms > 0 ? timeout_ms : 0);
+    uint32_t head = header_->head.load(std::memory_order_relaxed);
+    while (true)
+    {
+        uint32_t tail = header_->tail.load(std::memory_order_acquire);
+        if (tail == head)
+            return FRAME_RING_OK;
+        if (wait_for_change(header_->tail, header_->producer_waiting, tail, deadline, timeout_ms < 0) !=
+            FRAME_RING_OK)
+            return FRAME_RING_TIMEOUT;
+    }
+}
+
+FrameRingStatus FrameRing::acquire_read(FrameRingFrame &frame, int timeout_ms)
+{
+    auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms > 0 ? timeout_ms : 0);
+    uint32_t tail = header_->tail.load(std::memory_order_relaxed); // only the consumer writes tail
+    while (true)
+    {
+        uint32_t head = header_->head.load(std::memory_order_acquire);
+        if (head != tail)
+            break;
+        // closed is set after the last publish, so an empty ring seen after it stays empty
+        FrameRingStatus status = wait_for_change(header_->head, header_->consumer_waiting, head, deadline,
+                                                 timeout_ms < 0, &header_->closed);
+        if (status != FRAME_RING_OK)
+            return status;
+    }
+    const FrameRingSlot &slot = slot_table(header_)[tail & (header_->slot_count - 1)];
+    frame.pixels = slot_pixels(tail);
+    frame.index = slot.frame_index;
+    frame.timestamp_ns = slot.timestamp_ns;
+    frame.macroblocks = slot.macroblocks;
+    return FRAME_RING_OK;
+}
+
+void FrameRing::release_read()
+{
+    header_->tail.store(header_->tail.load(std::memory_order_relaxed) + 1);
+    notify(header_->tail, header_->producer_waiting);
+}
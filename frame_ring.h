@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "mdec.h"
+
+// Single-producer, single-consumer ring of decoded frames in a POSIX shared-memory object.
+// The producer decodes straight into a free slot and publishes it by advancing head; the
+// consumer reads the slot in place and hands it back by advancing tail. head and tail are
+// 32-bit counters that wrap, and double as futex words on Linux (elsewhere waits poll), so
+// neither side makes a system call unless the other is actually waiting. slot_count is a power
+// of two so slots stay in step when the counters wrap. The producer blocks while the consumer
+// is slot_count frames behind; no frame is dropped or overwritten.
+#define MDEC_FRAME_RING_MAGIC 0x474e5252 // "RRNG"
+#define MDEC_FRAME_RING_VERSION 1
+
+// Start of the shared object. FrameRingSlot[slot_count] follows, then the pixel slots at
+// data_offset, each slot_bytes apart (page aligned).
+struct FrameRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixel_format; // MdecPixelFormat
+    uint32_t slot_count;
+    uint64_t stride;
+    uint64_t slot_bytes;
+    uint64_t data_offset;
+
+    alignas(64) std::atomic<uint32_t> head; // frames published by the producer
+    std::atomic<uint32_t> consumer_waiting;
+    alignas(64) std::atomic<uint32_t> tail; // frames released by the consumer
+    std::atomic<uint32_t> producer_waiting;
+    alignas(64) std::atomic<uint32_t> closed; // set once the producer has no more frames
+};
+
+// Written by the producer before the slot is published
+struct FrameRingSlot
+{
+    uint64_t frame_index;
+    uint64_t timestamp_ns; // steady clock of the producer at publication
+    uint64_t macroblocks;
+};
+
+enum FrameRingStatus
+{
+    FRAME_RING_OK = 0,
+    FRAME_RING_TIMEOUT,
+    FRAME_RING_CLOSED // producer finished and every frame has been read
+};
+
+// A frame acquired by the consumer, valid until release_read()
+struct FrameRingFrame
+{
+    const uint8_t *pixels = nullptr;
+    uint64_t index = 0;
+    uint64_t timestamp_ns = 0;
+    uint64_t macroblocks = 0;
+};
+
+class FrameRing
+{
+public:
+    FrameRing() = default;
+    FrameRing(const FrameRing &) = delete;
+    FrameRing &operator=(const FrameRing &) = delete;
+    ~FrameRing();
+
+    // Producer: create the object, replacing any left by an earlier run. It is unlinked again
+    // when the producer's FrameRing is destroyed; consumers that mapped it keep working.
+    bool create(const std::string &name, int width, int height, MdecPixelFormat format, uint32_t slots,
+                std::string &error);
+
+    // Consumer: map an existing ring
+    bool open(const std::string &name, std::string &error);
+
+    // Producer: pixels of the next free slot, waiting up to timeout_ms (-1 = forever)
+    FrameRingStatus acquire_write(uint8_t *&pixels, int timeout_ms = -1);
+    void publish(const FrameRingSlot &info);
+    void close_producer();
+    // Producer: wait until the consumer has released every published frame
+    FrameRingStatus wait_drained(int timeout_ms = -1);
+
+    // Consumer: the oldest unread frame, waiting up to timeout_ms (-1 = forever)
+    FrameRingStatus acquire_read(FrameRingFrame &frame, int timeout_ms = -1);
+    void release_read();
+
+    const FrameRingHeader &header() const { return *header_; }
+
+private:
+    uint8_t *slot_pixels(uint32_t sequence) const;
+
+    FrameRingHeader *header_ = nullptr;
+    size_t size_ = 0;
+    std::string name_;
+    bool owner_ = false;
+};
@@ -0,0 +1,80 @@
+#include "frame_sequence.h"
+
+#include <cstring>
+
+#include "hash.h"
+#include "trace.h"
+
+FrameSequenceDecoder::FrameSequenceDecoder(int width, int height, size_t window)
+    : width_(width), height_(height),
+      macroblocks_per_frame_((size_t)((width + 15) / 16) * ((height + 15) / 16)),
+      window_(window > 0 ? window : 1)
+{
+}
+
+bool FrameSequenceDecoder::next(uint16_t **data, uint16_t *end, DecodedFrame &frame)
+{
+    uint64_t demux_start = trace_enabled() ? trace_now() : 0;
+
+    // Padding between frames is not part of the payload
+    while (*data < end && **data == 0xfe00)
+        (*data)++;
+
+    // Find the frame extent with a cheap block-boundary scan
+    uint16_t *start = *data;
+    uint16_t *frame_end = start;
+    if (skip_mdec_macroblocks(&frame_end, end, macroblocks_per_frame_) < macroblocks_per_frame_)
+        return false;
+
+    size_t words = frame_end - start;
+    uint64_t hash = mdec_hash64(start, words * sizeof(uint16_t));
+    *data = frame_end;
+
+    frame = DecodedFrame();
+    frame.index = frames_++;
+    frame.words = words;
+    clock_++;
+
+    // Most recent exact match in the window (the previous frame is the common case)
+    Slot *match = nullptr;
+    for (Slot &slot : window_)
+    {
+        if (slot.payload && slot.hash == hash && slot.words == words &&
+            memcmp(slot.payload, start, words * sizeof(uint16_t)) == 0 &&
+            (!match || slot.frame_index > match->frame_index))
+            match = &slot;
+    }
+
+    trace_span("demux", demux_start, (int64_t)frame.index);
+
+    if (match)
+    {
+        match->last_used = clock_;
+        frame.rgb = match->rgb.data();
+        frame.duplicate = true;
+        frame.duplicate_of = match->frame_index;
+        duplicates_++;
+        return true;
+    }
+
+    // Decode into the least recently used slot
+    Slot *slot = &window_[0];
+    for (Slot &s : window_)
+        if (s.last_used < slot->last_used)
+            slot = &s;
+
+    slot->rgb.assign((size_t)width_ * height_ * 3, 0);
+    uint16_t *p = start;
+    {
+        TraceScope trace("decode", (int64_t)frame.index);
+        decode_mdec_frame(ctx_, &p, frame_end, width_, height_, slot->rgb.data());
+    }
+
+    slot->hash = hash;
+    slot->payload = start;
+    slot->words = words;
+    slot->frame_index = frame.index;
+    slot->last_used = clock_;
+    frame.rgb = slot->rgb.data();
+    return true;
+}
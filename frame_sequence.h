@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mdec.h"
+
+// One frame produced by FrameSequenceDecoder
+struct DecodedFrame
+{
+    size_t index = 0;
+    const uint8_t *rgb = nullptr; // width * height * 3, valid until the next call to next()
+    size_t words = 0;             // compressed payload size
+
+    // The payload was byte-identical to an earlier frame still in the window, so rgb is that
+    // frame's output and no RLE, IDCT or colour conversion ran. Writers can reuse the
+    // encoded file of duplicate_of instead of encoding again.
+    bool duplicate = false;
+    size_t duplicate_of = 0;
+};
+
+// Decodes a stream of back-to-back MDEC frames of a fixed size (as dumped from an FMV),
+// skipping the decode of frames that repeat one of the last window frames exactly.
+// The input buffer must stay alive while the decoder is in use, since duplicates are
+// confirmed by comparing against the earlier payload in place.
+class FrameSequenceDecoder
+{
+public:
+    FrameSequenceDecoder(int width, int height, size_t window = 8);
+
+    // Decode the frame starting at *data and advance past it. Returns false at end of stream.
+    bool next(uint16_t **data, uint16_t *end, DecodedFrame &frame);
+
+    // Decoder state, e.g. to enable the macroblock cache or previous-frame reuse
+    MdecContext &context() { return ctx_; }
+
+    size_t frames() const { return frames_; }
+    size_t duplicates() const { return duplicates_; }
+
+private:
+    struct Slot
+    {
+        uint64_t hash = 0;
+        const uint16_t *payload = nullptr;
+        size_t words = 0;
+        size_t frame_index = 0;
+        uint64_t last_used = 0;
+        std::vector<uint8_t> rgb;
+    };
+
+    int width_;
+    int height_;
+    size_t macroblocks_per_frame_;
+    MdecContext ctx_;
+    std::vector<Slot> window_;
+    uint64_t clock_ = 0;
+    size_t frames_ = 0;
+    size_t duplicates_ = 0;
+};
@@ -0,0 +1,94 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "synthetic_stream.h"
+
+static void print_usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " <output.bin|-> [options]" << std::endl
+              << "  --size WxH       frame size (default 320x240)" << std::endl
+              << "  --frames N       back-to-back frames to generate (default 1)" << std::endl
+              << "  --density D      mean nonzero AC levels per block (default 8)" << std::endl
+              << "  --dc-only F      fraction of blocks with only a DC value (default 0)" << std::endl
+              << "  --q-scales LIST  per-frame q_scale weights, e.g. 2:1,8:3,16:1 (default 1,2,4,8,16,32)" << std::endl
+              << "  --seed N         PRNG seed; equal seeds give identical streams (default 1)" << std::endl;
+}
+
+// Generate synthetic MDEC streams. Frames are written as they are produced, so the output
+// can be far larger than memory; "-" writes to stdout for piping into other tools.
+int main(int argc, char *argv[])
+{
+    std::vector<const char *> args;
+    SyntheticStreamOptions options;
+    uint64_t frames = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool ok = true;
+        if (arg == "--size" && i + 1 < argc)
+            ok = sscanf(argv[++i], "%dx%d", &options.width, &options.height) == 2 && options.width > 0 &&
+                 options.height > 0;
+        else if (arg == "--frames" && i + 1 < argc)
+            frames = std::stoull(argv[++i]);
+        else if (arg == "--density" && i + 1 < argc)
+            options.density = std::stod(argv[++i]);
+        else if (arg == "--dc-only" && i + 1 < argc)
+            options.dc_only_fraction = std::stod(argv[++i]);
+        else if (arg == "--q-scales" && i + 1 < argc)
+            ok = parse_q_scale_distribution(argv[++i], options.q_scales);
+        else if (arg == "--seed" && i + 1 < argc)
+            options.seed = std::stoull(argv[++i]);
+        else
+            args.push_back(argv[i]);
+        if (!ok)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (args.size() != 1)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::string path = args[0];
+    FILE *out = path == "-" ? stdout : fopen(path.c_str(), "wb");
+    if (!out)
+    {
+        std::cerr << "Error: Could not open output file " << path << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    SyntheticStreamGenerator generator(options);
+    std::vector<uint16_t> words;
+    uint64_t total_words = 0;
+    for (uint64_t f = 0; f < frames; f++)
+    {
+        words.clear();
+        generator.next_frame(words);
+        if (fwrite(words.data(), sizeof(uint16_t), words.size(), out) != words.size())
+        {
+            std::cerr << "Error: Could not write " << path << std::endl;
+            return 1;
+        }
+        total_words += words.size();
+    }
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(out);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double mb = total_words * 2 / 1e6;
+    fprintf(stderr, "Generated %llu frames of %dx%d (%zu macroblocks each), %.2f MB in %.3f s (%.1f MB/s)\n",
+            (unsigned long long)frames, options.width, options.height, generator.macroblocks_per_frame(), mb,
+            seconds, mb / seconds);
+    return 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Fast non-cryptographic 64-bit hash (multiply/rotate over 8-byte lanes with a murmur-style
+// finaliser). Used to key caches on compressed MDEC data; not stable across endianness.
+inline uint64_t mdec_hash64(const void *data, size_t len, uint64_t seed = 0)
+{
+    const uint64_t k1 = 0x9e3779b185ebca87ull;
+    const uint64_t k2 = 0xc2b2ae3d27d4eb4full;
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    uint64_t h = seed ^ (len * k1);
+
+    while (len >= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        v *= k2;
+        v = (v << 31) | (v >> 33);
+        h ^= v * k1;
+        h = ((h << 27) | (h >> 37)) * k1 + k2;
+        p += 8;
+        len -= 8;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, p, len);
+    h ^= ((tail * k2) << 31 | (tail * k2) >> 33) * k1;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
@@ -0,0 +1,390 @@
+#include "image_reader.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+// Minimal DEFLATE decoder (RFC 1951) for PNG IDAT data, after zlib's puff.c
+namespace
+{
+struct Huffman
+{
+    uint16_t count[16];
+    uint16_t symbol[288];
+};
+
+struct Inflater
+{
+    const uint8_t *in;
+    size_t len;
+    size_t pos = 0;
+    uint32_t bitbuf = 0;
+    int bitcnt = 0;
+    bool error = false;
+    std::vector<uint8_t> &out;
+
+    Inflater(const uint8_t *data, size_t size, std::vector<uint8_t> &output)
+        : in(data), len(size), out(output) {}
+
+    int bits(int need)
+    {
+        while (bitcnt < need)
+        {
+            if (pos >= len)
+            {
+                error = true;
+                return 0;
+            }
+            bitbuf |= (uint32_t)in[pos++] << bitcnt;
+            bitcnt += 8;
+        }
+        int val = (int)(bitbuf & ((1u << need) - 1));
+        bitbuf >>= need;
+        bitcnt -= need;
+        return val;
+    }
+
+    int decode(const Huffman &h)
+    {
+        int code = 0, first = 0, index = 0;
+        for (int len = 1; len < 16; len++)
+        {
+            code |= bits(1);
+            int count = h.count[len];
+            if (code - count < first)
+                return h.symbol[index + (code - first)];
+            index += count;
+            first += count;
+            first <<= 1;
+            code <<= 1;
+            if (error)
+                break;
+        }
+        error = true;
+        return 0;
+    }
+};
+
+void build_huffman(Huffman &h, const uint8_t *lengths, int n)
+{
+    memset(h.count, 0, sizeof(h.count));
+    for (int i = 0; i < n; i++)
+        h.count[lengths[i]]++;
+    h.count[0] = 0;
+
+    uint16_t offs[16];
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++)
+        offs[len + 1] = offs[len] + h.count[len];
+    for (int i = 0; i < n; i++)
+        if (lengths[i])
+            h.symbol[offs[lengths[i]]++] = (uint16_t)i;
+}
+
+bool inflate_codes(Inflater &s, const Huffman &lencode, const Huffman &distcode)
+{
+    static const uint16_t lbase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t lext[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t dbase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const uint8_t dext[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    while (!s.error)
+    {
+        int symbol = s.decode(lencode);
+        if (symbol < 256)
+        {
+            s.out.push_back((uint8_t)symbol);
+        }
+        else if (symbol == 256)
+        {
+            return true;
+        }
+        else
+        {
+            symbol -= 257;
+            if (symbol >= 29)
+                return false;
+            int length = lbase[symbol] + s.bits(lext[symbol]);
+            symbol = s.decode(distcode);
+            if (symbol >= 30)
+                return false;
+            size_t dist = dbase[symbol] + s.bits(dext[symbol]);
+            if (dist > s.out.size())
+                return false;
+            size_t from = s.out.size() - dist;
+            for (int i = 0; i < length; i++)
+                s.out.push_back(s.out[from + i]);
+        }
+    }
+    return false;
+}
+
+bool inflate(const uint8_t *data, size_t size, std::vector<uint8_t> &out)
+{
+    Inflater s(data, size, out);
+    int last;
+    do
+    {
+        last = s.bits(1);
+        int type = s.bits(2);
+        if (type == 0)
+        {
+            // Stored block: restart at a byte boundary
+            s.bitbuf = 0;
+            s.bitcnt = 0;
+            if (s.pos + 4 > s.len)
+                return false;
+            unsigned len = s.in[s.pos] | (s.in[s.pos + 1] << 8);
+            unsigned nlen = s.in[s.pos + 2] | (s.in[s.pos + 3] << 8);
+            s.pos += 4;
+            if (len != (~nlen & 0xffff) || s.pos + len > s.len)
+                return false;
+            s.out.insert(s.out.end(), s.in + s.pos, s.in + s.pos + len);
+            s.pos += len;
+        }
+        else if (type == 1)
+        {
+            static Huffman lencode, distcode;
+            static bool built = false;
+            if (!built)
+            {
+                uint8_t lengths[288];
+                for (int i = 0; i < 288; i++)
+                    lengths[i] = i < 144 ? 8 : i < 256 ? 9
+                                           : i < 280   ? 7
+                                                       : 8;
+                build_huffman(lencode, lengths, 288);
+                for (int i = 0; i < 30; i++)
+                    lengths[i] = 5;
+                build_huffman(distcode, lengths, 30);
+                built = true;
+            }
+            if (!inflate_codes(s, lencode, distcode))
+                return false;
+        }
+        else if (type == 2)
+        {
+            static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+            int nlen = s.bits(5) + 257;
+            int ndist = s.bits(5) + 1;
+            int ncode = s.bits(4) + 4;
+            if (nlen > 286 || ndist > 30)
+                return false;
+
+            uint8_t lengths[320] = {};
+            for (int i = 0; i < ncode; i++)
+                lengths[order[i]] = (uint8_t)s.bits(3);
+            Huffman lencode, distcode;
+            build_huffman(lencode, lengths, 19);
+
+            int index = 0;
+            while (index < nlen + ndist && !s.error)
+            {
+                int symbol = s.decode(lencode);
+                if (symbol < 16)
+                {
+                    lengths[index++] = (uint8_t)symbol;
+                    continue;
+                }
+                int len = 0, repeat;
+                if (symbol == 16)
+                {
+                    if (index == 0)
+                        return false;
+                    len = lengths[index - 1];
+                    repeat = 3 + s.bits(2);
+                }
+                else if (symbol == 17)
+                    repeat = 3 + s.bits(3);
+                else
+                    repeat = 11 + s.bits(7);
+                if (index + repeat > nlen + ndist)
+                    return false;
+                while (repeat--)
+                    lengths[index++] = (uint8_t)len;
+            }
+            build_huffman(lencode, lengths, nlen);
+            build_huffman(distcode, lengths + nlen, ndist);
+            if (!inflate_codes(s, lencode, distcode))
+                return false;
+        }
+        else
+        {
+            return false;
+        }
+    } while (!last && !s.error);
+    return !s.error;
+}
+
+uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+bool read_png(const std::vector<uint8_t> &file, int &width, int &height, std::vector<uint8_t> &rgb)
+{
+    static const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    if (file.size() < 8 || memcmp(file.data(), signature, 8) != 0)
+        return false;
+
+    int bit_depth = 0, color_type = 0, interlace = 0;
+    std::vector<uint8_t> idat, palette;
+    size_t pos = 8;
+    while (pos + 12 <= file.size())
+    {
+        uint32_t len = be32(&file[pos]);
+        const uint8_t *type = &file[pos + 4];
+        const uint8_t *body = &file[pos + 8];
+        if (pos + 12 + len > file.size())
+            return false;
+        if (memcmp(type, "IHDR", 4) == 0 && len >= 13)
+        {
+            width = (int)be32(body);
+            height = (int)be32(body + 4);
+            bit_depth = body[8];
+            color_type = body[9];
+            interlace = body[12];
+        }
+        else if (memcmp(type, "PLTE", 4) == 0)
+            palette.assign(body, body + len);
+        else if (memcmp(type, "IDAT", 4) == 0)
+            idat.insert(idat.end(), body, body + len);
+        else if (memcmp(type, "IEND", 4) == 0)
+            break;
+        pos += 12 + len;
+    }
+
+    int channels = color_type == 0 ? 1 : color_type == 2 ? 3
+                                     : color_type == 3   ? 1
+                                     : color_type == 4   ? 2
+                                     : color_type == 6   ? 4
+                                                         : 0;
+    if (bit_depth != 8 || interlace != 0 || channels == 0 || idat.size() < 2 || width <= 0 || height <= 0)
+    {
+        std::cerr << "Error: only 8-bit non-interlaced PNGs are supported" << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> raw;
+    size_t stride = (size_t)width * channels;
+    raw.reserve((stride + 1) * height);
+    if (!inflate(idat.data() + 2, idat.size() - 2, raw) || raw.size() < (stride + 1) * height)
+        return false;
+
+    // Undo the per-row filters in place
+    std::vector<uint8_t> pixels(stride * height);
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t filter = raw[y * (stride + 1)];
+        const uint8_t *src = &raw[y * (stride + 1) + 1];
+        uint8_t *dst = &pixels[y * stride];
+        const uint8_t *up = y > 0 ? dst - stride : nullptr;
+        for (size_t i = 0; i < stride; i++)
+        {
+            int a = i >= (size_t)channels ? dst[i - channels] : 0;
+            int b = up ? up[i] : 0;
+            int c = up && i >= (size_t)channels ? up[i - channels] : 0;
+            int pred = 0;
+            switch (filter)
+            {
+            case 1:
+                pred = a;
+                break;
+            case 2:
+                pred = b;
+                break;
+            case 3:
+                pred = (a + b) >> 1;
+                break;
+            case 4:
+            {
+                int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+                pred = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                break;
+            }
+            }
+            dst[i] = (uint8_t)(src[i] + pred);
+        }
+    }
+
+    rgb.resize((size_t)width * height * 3);
+    for (size_t i = 0; i < (size_t)width * height; i++)
+    {
+        const uint8_t *p = &pixels[i * channels];
+        uint8_t *o = &rgb[i * 3];
+        if (color_type == 3)
+        {
+            size_t entry = (size_t)p[0] * 3;
+            if (entry + 2 >= palette.size())
+                return false;
+            memcpy(o, &palette[entry], 3);
+        }
+        else if (channels <= 2)
+            o[0] = o[1] = o[2] = p[0];
+        else
+            memcpy(o, p, 3);
+    }
+    return true;
+}
+
+bool read_ppm(const std::vector<uint8_t> &file, int &width, int &height, std::vector<uint8_t> &rgb)
+{
+    // Header fields are whitespace separated, with # comments
+    size_t pos = 2;
+    int fields[3];
+    for (int &field : fields)
+    {
+        while (pos < file.size() && (isspace(file[pos]) || file[pos] == '#'))
+        {
+            if (file[pos] == '#')
+                while (pos < file.size() && file[pos] != '\n')
+                    pos++;
+            else
+                pos++;
+        }
+        field = 0;
+        while (pos < file.size() && isdigit(file[pos]))
+            field = field * 10 + (file[pos++] - '0');
+    }
+    pos++; // single whitespace before the raster
+
+    width = fields[0];
+    height = fields[1];
+    size_t bytes = (size_t)width * height * 3;
+    if (fields[2] != 255 || width <= 0 || height <= 0 || pos + bytes > file.size())
+        return false;
+    rgb.assign(file.begin() + pos, file.begin() + pos + bytes);
+    return true;
+}
+} // namespace
+
+bool read_image(const char *path, int &width, int &height, std::vector<uint8_t> &rgb)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "Error: Could not open input file " << path << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    bool ok;
+    if (file.size() >= 8 && file[0] == 137 && file[1] == 'P' && file[2] == 'N' && file[3] == 'G')
+        ok = read_png(file, width, height, rgb);
+    else if (file.size() >= 2 && file[0] == 'P' && file[1] == '6')
+        ok = read_ppm(file, width, height, rgb);
+    else
+    {
+        size_t bytes = (size_t)width * height * 3;
+        ok = width > 0 && height > 0 && file.size() >= bytes;
+        if (ok)
+            rgb.assign(file.begin(), file.begin() + bytes);
+    }
+
+    if (!ok)
+        std::cerr << "Error: Could not decode " << path << std::endl;
+    return ok;
+}
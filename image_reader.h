@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Load an image as packed RGB24 (top row first). Supports 8-bit non-interlaced PNG (grey,
+// grey+alpha, RGB, RGBA and palette; alpha is dropped) and binary PPM (P6, maxval 255).
+// Any other extension is read as raw RGB24, which needs width and height set by the caller.
+bool read_image(const char *path, int &width, int &height, std::vector<uint8_t> &rgb);
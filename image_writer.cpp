@@ -0,0 +1,535 @@
+#include "image_writer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+#include "trace.h"
+
+ImageFormat image_format_from_path(const char *path)
+{
+    std::string p(path);
+    size_t dot = p.find_last_of('.');
+    if (dot == std::string::npos)
+        return IMAGE_FORMAT_PNG;
+
+    std::string ext = p.substr(dot + 1);
+    for (char &c : ext)
+        c = (char)tolower((unsigned char)c);
+
+    if (ext == "ppm")
+        return IMAGE_FORMAT_PPM;
+    if (ext == "bmp")
+        return IMAGE_FORMAT_BMP;
+    if (ext == "tga")
+        return IMAGE_FORMAT_TGA;
+    if (ext == "qoi")
+        return IMAGE_FORMAT_QOI;
+    if (ext == "jpg" || ext == "jpeg")
+        return IMAGE_FORMAT_JPEG;
+    return IMAGE_FORMAT_PNG;
+}
+
+bool write_bytes(const char *path, const std::vector<uint8_t> &bytes)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+    file.write(reinterpret_cast<const char *>(bytes.data()), (std::streamsize)bytes.size());
+    return (bool)file;
+}
+
+static void put_le16(std::vector<uint8_t> &out, uint32_t v)
+{
+    out.push_back((uint8_t)v);
+    out.push_back((uint8_t)(v >> 8));
+}
+
+static void put_le32(std::vector<uint8_t> &out, uint32_t v)
+{
+    put_le16(out, v & 0xffff);
+    put_le16(out, v >> 16);
+}
+
+static void put_be32(std::vector<uint8_t> &out, uint32_t v)
+{
+    out.push_back((uint8_t)(v >> 24));
+    out.push_back((uint8_t)(v >> 16));
+    out.push_back((uint8_t)(v >> 8));
+    out.push_back((uint8_t)v);
+}
+
+// Binary PPM (P6): header followed by the framebuffer as-is
+bool write_ppm(const char *path, int width, int height, const uint8_t *rgb)
+{
+    std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+    size_t pixel_bytes = (size_t)width * height * 3;
+
+    std::vector<uint8_t> out(header.size() + pixel_bytes);
+    memcpy(out.data(), header.data(), header.size());
+    memcpy(out.data() + header.size(), rgb, pixel_bytes);
+    return write_bytes(path, out);
+}
+
+// 24-bit BMP, stored top-down (negative height) so rows go out in framebuffer order
+bool write_bmp(const char *path, int width, int height, const uint8_t *rgb)
+{
+    int row_bytes = (width * 3 + 3) & ~3;
+    uint32_t pixel_bytes = (uint32_t)row_bytes * height;
+
+    std::vector<uint8_t> out;
+    out.reserve(54 + pixel_bytes);
+
+    // BITMAPFILEHEADER
+    out.push_back('B');
+    out.push_back('M');
+    put_le32(out, 54 + pixel_bytes);
+    put_le32(out, 0);
+    put_le32(out, 54);
+
+    // BITMAPINFOHEADER
+    put_le32(out, 40);
+    put_le32(out, (uint32_t)width);
+    put_le32(out, (uint32_t)-height);
+    put_le16(out, 1);
+    put_le16(out, 24);
+    put_le32(out, 0); // BI_RGB
+    put_le32(out, pixel_bytes);
+    put_le32(out, 2835); // 72 DPI
+    put_le32(out, 2835);
+    put_le32(out, 0);
+    put_le32(out, 0);
+
+    out.resize(54 + pixel_bytes);
+    for (int y = 0; y < height; y++)
+    {
+        const uint8_t *src = rgb + (size_t)y * width * 3;
+        uint8_t *dst = out.data() + 54 + (size_t)y * row_bytes;
+        for (int x = 0; x < width; x++)
+        {
+            dst[x * 3] = src[x * 3 + 2];
+            dst[x * 3 + 1] = src[x * 3 + 1];
+            dst[x * 3 + 2] = src[x * 3];
+        }
+        memset(dst + width * 3, 0, row_bytes - width * 3);
+    }
+    return write_bytes(path, out);
+}
+
+// Uncompressed true-colour TGA with a top-left origin
+bool write_tga(const char *path, int width, int height, const uint8_t *rgb)
+{
+    size_t pixel_bytes = (size_t)width * height * 3;
+
+    std::vector<uint8_t> out(18 + pixel_bytes);
+    uint8_t *h = out.data();
+    memset(h, 0, 18);
+    h[2] = 2; // uncompressed true-colour
+    h[12] = (uint8_t)width;
+    h[13] = (uint8_t)(width >> 8);
+    h[14] = (uint8_t)height;
+    h[15] = (uint8_t)(height >> 8);
+    h[16] = 24;
+    h[17] = 0x20; // top-left origin
+
+    uint8_t *dst = out.data() + 18;
+    for (size_t i = 0; i < pixel_bytes; i += 3)
+    {
+        dst[i] = rgb[i + 2];
+        dst[i + 1] = rgb[i + 1];
+        dst[i + 2] = rgb[i];
+    }
+    return write_bytes(path, out);
+}
+
+// QOI, see https://qoiformat.org/qoi-specification.pdf
+bool write_qoi(const char *path, int width, int height, const uint8_t *rgb)
+{
+    size_t pixel_count = (size_t)width * height;
+
+    std::vector<uint8_t> out;
+    out.reserve(14 + pixel_count * 4 + 8); // worst case is QOI_OP_RGB for every pixel
+
+    put_be32(out, 0x716f6966); // "qoif"
+    put_be32(out, (uint32_t)width);
+    put_be32(out, (uint32_t)height);
+    out.push_back(3); // RGB
+    out.push_back(0); // sRGB with linear alpha
+
+    // RGBA as the decoder holds it: every slot starts as (0, 0, 0, 0), which no opaque pixel matches
+    uint8_t index[64][4] = {};
+    uint8_t prev[3] = {0, 0, 0};
+    int run = 0;
+
+    for (size_t i = 0; i < pixel_count; i++)
+    {
+        const uint8_t *px = rgb + i * 3;
+
+        if (px[0] == prev[0] && px[1] == prev[1] && px[2] == prev[2])
+        {
+            run++;
+            if (run == 62 || i == pixel_count - 1)
+            {
+                out.push_back((uint8_t)(0xc0 | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run > 0)
+        {
+            out.push_back((uint8_t)(0xc0 | (run - 1)));
+            run = 0;
+        }
+
+        int pos = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64;
+        if (index[pos][0] == px[0] && index[pos][1] == px[1] && index[pos][2] == px[2] && index[pos][3] == 255)
+        {
+            out.push_back((uint8_t)pos);
+        }
+        else
+        {
+            memcpy(index[pos], px, 3);
+            index[pos][3] = 255;
+
+            int8_t vr = (int8_t)(px[0] - prev[0]);
+            int8_t vg = (int8_t)(px[1] - prev[1]);
+            int8_t vb = (int8_t)(px[2] - prev[2]);
+            int8_t vg_r = (int8_t)(vr - vg);
+            int8_t vg_b = (int8_t)(vb - vg);
+
+            if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+            {
+                out.push_back((uint8_t)(0x40 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2)));
+            }
+            else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8)
+            {
+                out.push_back((uint8_t)(0x80 | (vg + 32)));
+                out.push_back((uint8_t)((vg_r + 8) << 4 | (vg_b + 8)));
+            }
+            else
+            {
+                out.insert(out.end(), {0xfe, px[0], px[1], px[2]});
+            }
+        }
+        memcpy(prev, px, 3);
+    }
+
+    out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+    return write_bytes(path, out);
+}
+
+// Deflate one stripe of filtered PNG rows as raw DEFLATE blocks (no zlib header or adler32).
+// This is stb_image_write's fixed-Huffman compressor, except that non-final stripes end with
+// an empty stored block (a sync flush) so the next stripe starts on a byte boundary and the
+// stripes can simply be concatenated.
+static std::vector<uint8_t> deflate_stripe(unsigned char *data, int data_len, int quality, bool final)
+{
+    static unsigned short lengthc[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 259};
+    static unsigned char lengtheb[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static unsigned short distc[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 32768};
+    static unsigned char disteb[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    unsigned int bitbuf = 0;
+    int i, j, bitcount = 0;
+    unsigned char *out = NULL;
+    std::vector<unsigned char **> hash_table(stbiw__ZHASH, nullptr);
+    if (quality < 5)
+        quality = 5;
+
+    stbiw__zlib_add(final ? 1 : 0, 1); // BFINAL
+    stbiw__zlib_add(1, 2);             // BTYPE = 1 -- fixed huffman
+
+    i = 0;
+    while (i < data_len - 3)
+    {
+        // hash next 3 bytes of data to be compressed
+        int h = stbiw__zhash(data + i) & (stbiw__ZHASH - 1), best = 3;
+        unsigned char *bestloc = 0;
+        unsigned char **hlist = hash_table[h];
+        int n = stbiw__sbcount(hlist);
+        for (j = 0; j < n; ++j)
+        {
+            if (hlist[j] - data > i - 32768)
+            {
+                int d = stbiw__zlib_countm(hlist[j], data + i, data_len - i);
+                if (d >= best)
+                {
+                    best = d;
+                    bestloc = hlist[j];
+                }
+            }
+        }
+        // when hash table entry is too long, delete half the entries
+        if (hash_table[h] && stbiw__sbn(hash_table[h]) == 2 * quality)
+        {
+            STBIW_MEMMOVE(hash_table[h], hash_table[h] + quality, sizeof(hash_table[h][0]) * quality);
+            stbiw__sbn(hash_table[h]) = quality;
+        }
+        stbiw__sbpush(hash_table[h], data + i);
+
+        if (bestloc)
+        {
+            // lazy matching: if the match at the next byte is better, emit this byte as a literal
+            h = stbiw__zhash(data + i + 1) & (stbiw__ZHASH - 1);
+            hlist = hash_table[h];
+            n = stbiw__sbcount(hlist);
+            for (j = 0; j < n; ++j)
+            {
+                if (hlist[j] - data > i - 32767)
+                {
+                    int e = stbiw__zlib_countm(hlist[j], data + i + 1, data_len - i - 1);
+                    if (e > best)
+                    {
+                        bestloc = NULL;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (bestloc)
+        {
+            int d = (int)(data + i - bestloc); // distance back
+            for (j = 0; best > lengthc[j + 1] - 1; ++j)
+                ;
+            stbiw__zlib_huff(j + 257);
+            if (lengtheb[j])
+                stbiw__zlib_add(best - lengthc[j], lengtheb[j]);
+            for (j = 0; d > distc[j + 1] - 1; ++j)
+                ;
+            stbiw__zlib_add(stbiw__zlib_bitrev(j, 5), 5);
+            if (disteb[j])
+                stbiw__zlib_add(d - distc[j], disteb[j]);
+            i += best;
+        }
+        else
+        {
+            stbiw__zlib_huffb(data[i]);
+            ++i;
+        }
+    }
+    // write out final bytes
+    for (; i < data_len; ++i)
+        stbiw__zlib_huffb(data[i]);
+    stbiw__zlib_huff(256); // end of block
+
+    if (!final)
+        stbiw__zlib_add(0, 3); // empty stored block: BFINAL = 0, BTYPE = 0
+    // pad with 0 bits to byte boundary
+    while (bitcount)
+        stbiw__zlib_add(0, 1);
+    if (!final)
+    {
+        stbiw__sbpush(out, 0x00); // LEN
+        stbiw__sbpush(out, 0x00);
+        stbiw__sbpush(out, 0xff); // NLEN
+        stbiw__sbpush(out, 0xff);
+    }
+
+    for (i = 0; i < stbiw__ZHASH; ++i)
+        (void)stbiw__sbfree(hash_table[i]);
+
+    // store uncompressed instead if compression was worse
+    if (stbiw__sbn(out) > data_len + ((data_len + 32766) / 32767) * 5)
+    {
+        stbiw__sbn(out) = 0;
+        for (j = 0; j < data_len;)
+        {
+            int blocklen = data_len - j;
+            if (blocklen > 32767)
+                blocklen = 32767;
+            stbiw__sbpush(out, final && data_len - j == blocklen); // BFINAL = ?, BTYPE = 0 -- no compression
+            stbiw__sbpush(out, STBIW_UCHAR(blocklen));             // LEN
+            stbiw__sbpush(out, STBIW_UCHAR(blocklen >> 8));
+            stbiw__sbpush(out, STBIW_UCHAR(~blocklen)); // NLEN
+            stbiw__sbpush(out, STBIW_UCHAR(~blocklen >> 8));
+            stbiw__sbmaybegrow(out, blocklen);
+            memcpy(out + stbiw__sbn(out), data + j, blocklen);
+            stbiw__sbn(out) += blocklen;
+            j += blocklen;
+        }
+    }
+
+    std::vector<uint8_t> result(out, out + stbiw__sbn(out));
+    (void)stbiw__sbfree(out);
+    return result;
+}
+
+static uint32_t adler32(const uint8_t *data, size_t len)
+{
+    uint32_t s1 = 1, s2 = 0;
+    while (len > 0)
+    {
+        size_t block = len < 5552 ? len : 5552;
+        for (size_t i = 0; i < block; i++)
+        {
+            s1 += data[i];
+            s2 += s1;
+        }
+        s1 %= 65521;
+        s2 %= 65521;
+        data += block;
+        len -= block;
+    }
+    return (s2 << 16) | s1;
+}
+
+// adler32 of A followed by B, given adler32(A), adler32(B) and len(B) (as zlib's adler32_combine)
+static uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2)
+{
+    const uint64_t base = 65521;
+    uint64_t rem = len2 % base;
+    uint64_t sum1 = adler1 & 0xffff;
+    uint64_t sum2 = (rem * sum1) % base;
+    sum1 += (adler2 & 0xffff) + base - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + base - rem;
+    sum1 %= base;
+    sum2 %= base;
+    return (uint32_t)((sum2 << 16) | sum1);
+}
+
+// Filter rows [y0, y1) into out, each prefixed by its filter type byte
+static void filter_png_rows(const uint8_t *rgb, int width, int height, int y0, int y1, int filter,
+                            uint8_t *out)
+{
+    int row_bytes = width * 3;
+    std::vector<signed char> line_buffer(row_bytes);
+    unsigned char *pixels = const_cast<unsigned char *>(rgb);
+
+    for (int y = y0; y < y1; y++)
+    {
+        int filter_type = filter;
+        if (filter_type < 0 || filter_type > 4)
+        {
+            // Estimate the best filter by running through all of them, as stb does
+            int best_filter = 0, best_filter_val = 0x7fffffff;
+            for (filter_type = 0; filter_type < 5; filter_type++)
+            {
+                stbiw__encode_png_line(pixels, row_bytes, width, height, y, 3, filter_type, line_buffer.data());
+                int est = 0;
+                for (int i = 0; i < row_bytes; ++i)
+                    est += abs(line_buffer[i]);
+                if (est < best_filter_val)
+                {
+                    best_filter_val = est;
+                    best_filter = filter_type;
+                }
+            }
+            filter_type = best_filter;
+        }
+        stbiw__encode_png_line(pixels, row_bytes, width, height, y, 3, filter_type, line_buffer.data());
+
+        uint8_t *dst = out + (size_t)(y - y0) * (row_bytes + 1);
+        dst[0] = (uint8_t)filter_type;
+        memcpy(dst + 1, line_buffer.data(), row_bytes);
+    }
+}
+
+static void put_png_chunk(std::vector<uint8_t> &out, const char *tag, const uint8_t *data, size_t len)
+{
+    put_be32(out, (uint32_t)len);
+    size_t start = out.size();
+    out.insert(out.end(), tag, tag + 4);
+    out.insert(out.end(), data, data + len);
+    put_be32(out, stbiw__crc32(out.data() + start, (int)(len + 4)));
+}
+
+// PNG encoder that filters and deflates horizontal stripes on separate threads
+static bool write_png_striped(const char *path, int width, int height, const uint8_t *rgb,
+                              const PngOptions &options)
+{
+    int stripes = std::max(1, std::min(options.threads, height));
+    size_t row_bytes = (size_t)width * 3 + 1;
+
+    struct Stripe
+    {
+        int y0, y1;
+        std::vector<uint8_t> deflated;
+        uint32_t adler;
+    };
+    std::vector<Stripe> work(stripes);
+
+    auto encode_stripe = [&](int s)
+    {
+        TraceScope trace("png stripe", s);
+        Stripe &stripe = work[s];
+        stripe.y0 = (int)((int64_t)height * s / stripes);
+        stripe.y1 = (int)((int64_t)height * (s + 1) / stripes);
+
+        std::vector<uint8_t> filtered(row_bytes * (stripe.y1 - stripe.y0));
+        filter_png_rows(rgb, width, height, stripe.y0, stripe.y1, options.filter, filtered.data());
+        stripe.adler = adler32(filtered.data(), filtered.size());
+        stripe.deflated = deflate_stripe(filtered.data(), (int)filtered.size(),
+                                         options.compression_level, s == stripes - 1);
+    };
+
+    if (stripes == 1)
+    {
+        encode_stripe(0);
+    }
+    else
+    {
+        std::vector<std::thread> threads;
+        for (int s = 0; s < stripes; s++)
+            threads.emplace_back(encode_stripe, s);
+        for (std::thread &t : threads)
+            t.join();
+    }
+
+    // Stitch the stripes into one zlib stream
+    std::vector<uint8_t> zlib = {0x78, 0x5e}; // DEFLATE 32K window, FLEVEL = 1
+    uint32_t adler = 1;
+    for (const Stripe &stripe : work)
+    {
+        zlib.insert(zlib.end(), stripe.deflated.begin(), stripe.deflated.end());
+        adler = adler32_combine(adler, stripe.adler, row_bytes * (stripe.y1 - stripe.y0));
+    }
+    put_be32(zlib, adler);
+
+    std::vector<uint8_t> out = {137, 80, 78, 71, 13, 10, 26, 10};
+    std::vector<uint8_t> ihdr;
+    put_be32(ihdr, (uint32_t)width);
+    put_be32(ihdr, (uint32_t)height);
+    ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0}); // 8-bit RGB, deflate, adaptive filtering, no interlace
+    put_png_chunk(out, "IHDR", ihdr.data(), ihdr.size());
+    put_png_chunk(out, "IDAT", zlib.data(), zlib.size());
+    put_png_chunk(out, "IEND", nullptr, 0);
+    return write_bytes(path, out);
+}
+
+// stb's own PNG writer reads its settings from globals, which batch workers would race on,
+// so every PNG goes through the stripe encoder; with one stripe it matches stbi_write_png.
+bool write_png(const char *path, int width, int height, const uint8_t *rgb, const PngOptions &options)
+{
+    return write_png_striped(path, width, height, rgb, options);
+}
+
+bool write_jpeg(const char *path, int width, int height, const uint8_t *rgb)
+{
+    return stbi_write_jpg(path, width, height, 3, rgb, 90) != 0;
+}
+
+bool write_image(const char *path, int width, int height, const uint8_t *rgb,
+                 const PngOptions &png_options)
+{
+    switch (image_format_from_path(path))
+    {
+    case IMAGE_FORMAT_PPM:
+        return write_ppm(path, width, height, rgb);
+    case IMAGE_FORMAT_BMP:
+        return write_bmp(path, width, height, rgb);
+    case IMAGE_FORMAT_TGA:
+        return write_tga(path, width, height, rgb);
+    case IMAGE_FORMAT_QOI:
+        return write_qoi(path, width, height, rgb);
+    case IMAGE_FORMAT_JPEG:
+        return write_jpeg(path, width, height, rgb);
+    default:
+        return write_png(path, width, height, rgb, png_options);
+    }
+}
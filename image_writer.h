@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Output container, selected from the output file extension
+enum ImageFormat
+{
+    IMAGE_FORMAT_PNG = 0,
+    IMAGE_FORMAT_PPM = 1,
+    IMAGE_FORMAT_BMP = 2,
+    IMAGE_FORMAT_TGA = 3,
+    IMAGE_FORMAT_QOI = 4,
+    IMAGE_FORMAT_JPEG = 5
+};
+
+// PNG encoder settings. compression_level and filter map onto stb_image_write's
+// stbi_write_png_compression_level and stbi_write_force_png_filter (-1 = try all five
+// filters per row). With threads > 1 the image is split into horizontal stripes that are
+// filtered and deflated concurrently, then stitched into a single zlib stream.
+struct PngOptions
+{
+    int compression_level = 8;
+    int filter = -1;
+    int threads = 1;
+};
+
+// Pick the writer for a path (.ppm, .bmp, .tga, .qoi, .jpg/.jpeg; anything else is PNG)
+ImageFormat image_format_from_path(const char *path);
+
+// Write a packed RGB24 framebuffer (width * 3 bytes per row, top row first).
+// The uncompressed and QOI writers build the whole file in memory and issue a single write.
+bool write_ppm(const char *path, int width, int height, const uint8_t *rgb);
+bool write_bmp(const char *path, int width, int height, const uint8_t *rgb);
+bool write_tga(const char *path, int width, int height, const uint8_t *rgb);
+bool write_qoi(const char *path, int width, int height, const uint8_t *rgb);
+bool write_png(const char *path, int width, int height, const uint8_t *rgb,
+               const PngOptions &options = PngOptions());
+
+// Pixel-domain JPEG through stb_image_write (quality 90). Raw MDEC input converted to .jpg
+// goes through transcode_mdec_to_jpeg instead, which never leaves the DCT domain.
+bool write_jpeg(const char *path, int width, int height, const uint8_t *rgb);
+
+// Write an already encoded file in one call
+bool write_bytes(const char *path, const std::vector<uint8_t> &bytes);
+
+// Write using the format implied by the path
+bool write_image(const char *path, int width, int height, const uint8_t *rgb,
+                 const PngOptions &png_options = PngOptions());
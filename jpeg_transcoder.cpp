@@ -0,0 +1,247 @@
+#include "jpeg_transcoder.h"
+
+#include <algorithm>
+
+// Standard Huffman tables (ITU T.81 Annex K.3)
+static const uint8_t std_dc_luminance_nrcodes[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t std_dc_luminance_values[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t std_ac_luminance_nrcodes[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t std_ac_luminance_values[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+    0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+    0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+static const uint8_t std_dc_chrominance_nrcodes[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t std_dc_chrominance_values[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t std_ac_chrominance_nrcodes[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t std_ac_chrominance_values[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+    0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+    0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+struct HuffmanTable
+{
+    uint16_t code[256];
+    uint8_t size[256];
+};
+
+// Canonical code assignment (T.81 Annex C)
+static HuffmanTable build_huffman(const uint8_t nrcodes[16], const uint8_t *values)
+{
+    HuffmanTable table = {};
+    uint16_t code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; len++)
+    {
+        for (int i = 0; i < nrcodes[len - 1]; i++)
+        {
+            table.code[values[k]] = code++;
+            table.size[values[k]] = (uint8_t)len;
+            k++;
+        }
+        code <<= 1;
+    }
+    return table;
+}
+
+// Entropy-coded segment writer with 0xFF byte stuffing
+struct BitWriter
+{
+    std::vector<uint8_t> &out;
+    uint32_t buffer = 0;
+    int count = 0;
+
+    void put(uint32_t bits, int length)
+    {
+        buffer = (buffer << length) | (bits & ((1u << length) - 1));
+        count += length;
+        while (count >= 8)
+        {
+            uint8_t byte = (uint8_t)(buffer >> (count - 8));
+            out.push_back(byte);
+            if (byte == 0xff)
+                out.push_back(0x00);
+            count -= 8;
+        }
+    }
+
+    void flush()
+    {
+        if (count > 0)
+            put(0x7f, 8 - count); // pad with 1 bits
+    }
+};
+
+// Magnitude category and the value bits that follow it
+static inline int jpeg_category(int v)
+{
+    int a = v < 0 ? -v : v;
+    int n = 0;
+    while (a)
+    {
+        n++;
+        a >>= 1;
+    }
+    return n;
+}
+
+static inline int requantize(int v, int q)
+{
+    return v >= 0 ? (v + q / 2) / q : -((-v + q / 2) / q);
+}
+
+static void encode_block(BitWriter &bits, const int16_t *coef, const uint8_t *quant, int &dc_pred,
+                         const HuffmanTable &dc, const HuffmanTable &ac)
+{
+    int dc_value = std::min(std::max(requantize(coef[0], quant[0]), -2047), 2047);
+    int diff = dc_value - dc_pred;
+    dc_pred = dc_value;
+
+    int cat = jpeg_category(diff);
+    bits.put(dc.code[cat], dc.size[cat]);
+    if (cat)
+        bits.put(diff < 0 ? diff - 1 : diff, cat);
+
+    int run = 0;
+    for (int k = 1; k < 64; k++)
+    {
+        int v = std::min(std::max(requantize(coef[zagzig[k]], quant[k]), -1023), 1023);
+        if (v == 0)
+        {
+            run++;
+            continue;
+        }
+        while (run >= 16)
+        {
+            bits.put(ac.code[0xf0], ac.size[0xf0]); // ZRL
+            run -= 16;
+        }
+        cat = jpeg_category(v);
+        int symbol = (run << 4) | cat;
+        bits.put(ac.code[symbol], ac.size[symbol]);
+        bits.put(v < 0 ? v - 1 : v, cat);
+        run = 0;
+    }
+    if (run)
+        bits.put(ac.code[0x00], ac.size[0x00]); // EOB
+}
+
+static void put_marker(std::vector<uint8_t> &out, uint8_t marker, uint16_t length)
+{
+    out.push_back(0xff);
+    out.push_back(marker);
+    out.push_back((uint8_t)(length >> 8));
+    out.push_back((uint8_t)length);
+}
+
+static void put_dht(std::vector<uint8_t> &out, uint8_t id, const uint8_t nrcodes[16], const uint8_t *values, int count)
+{
+    out.push_back(id);
+    out.insert(out.end(), nrcodes, nrcodes + 16);
+    out.insert(out.end(), values, values + count);
+}
+
+size_t transcode_mdec_to_jpeg(MdecContext &ctx, uint16_t **data, uint16_t *end, int width, int height,
+                              std::vector<uint8_t> &jpeg)
+{
+    int mb_rows = (height + 15) / 16;
+    int mb_cols = (width + 15) / 16;
+    size_t mb_total = (size_t)mb_rows * mb_cols;
+
+    // Gather dequantised coefficients of every block (Cr, Cb, Y0-Y3 per macroblock)
+    ctx.coefficients.assign(mb_total * 6 * 64, 0);
+    size_t q_scale_count[64] = {};
+    size_t mb_decoded = 0;
+    for (; mb_decoded < mb_total; mb_decoded++)
+    {
+        static const MdecBlockType types[6] = {MDEC_BLOCK_CR, MDEC_BLOCK_CB, MDEC_BLOCK_Y,
+                                               MDEC_BLOCK_Y, MDEC_BLOCK_Y, MDEC_BLOCK_Y};
+        ctx.early_terminate = false;
+        for (int b = 0; b < 6 && !ctx.early_terminate; b++)
+        {
+            rle_decode(ctx, data, ctx.coefficients.data() + (mb_decoded * 6 + b) * 64, types[b], end, false);
+            if (!ctx.early_terminate)
+                q_scale_count[ctx.q_scale]++;
+        }
+        if (ctx.early_terminate)
+            break;
+    }
+
+    // Requantisation tables (zigzag order): the context's MDEC tables at the dominant q_scale.
+    // DC is dequantised as val * quant, so it is always exact.
+    int q_scale = (int)(std::max_element(q_scale_count + 1, q_scale_count + 64) - q_scale_count);
+    if (q_scale_count[q_scale] == 0)
+        q_scale = 8; // only q_scale 0 (or no blocks); AC was dequantised as val * 2
+    const MdecQuantTables *quant = ctx.quant;
+    uint8_t y_dqt[64], c_dqt[64];
+    for (int k = 0; k < 64; k++)
+    {
+        y_dqt[k] = (uint8_t)std::min(std::max((quant->factors(true, q_scale)[k] + 4) / 8, 1), 255);
+        c_dqt[k] = (uint8_t)std::min(std::max((quant->factors(false, q_scale)[k] + 4) / 8, 1), 255);
+    }
+    y_dqt[0] = quant->y[0] ? quant->y[0] : 2;
+    c_dqt[0] = quant->c[0] ? quant->c[0] : 2;
+
+    jpeg.clear();
+    jpeg.reserve(1024 + mb_decoded * 256);
+
+    // SOI + JFIF APP0
+    jpeg.insert(jpeg.end(), {0xff, 0xd8});
+    put_marker(jpeg, 0xe0, 16);
+    jpeg.insert(jpeg.end(), {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0});
+
+    // DQT: luma table 0, chroma table 1
+    put_marker(jpeg, 0xdb, 2 + 2 * 65);
+    jpeg.push_back(0x00);
+    jpeg.insert(jpeg.end(), y_dqt, y_dqt + 64);
+    jpeg.push_back(0x01);
+    jpeg.insert(jpeg.end(), c_dqt, c_dqt + 64);
+
+    // SOF0: 4:2:0 Y/Cb/Cr, matching the MDEC macroblock layout
+    put_marker(jpeg, 0xc0, 17);
+    jpeg.insert(jpeg.end(), {8, (uint8_t)(height >> 8), (uint8_t)height, (uint8_t)(width >> 8), (uint8_t)width, 3,
+                             1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1});
+
+    // DHT
+    put_marker(jpeg, 0xc4, 2 + 4 * 17 + 12 + 162 + 12 + 162);
+    put_dht(jpeg, 0x00, std_dc_luminance_nrcodes, std_dc_luminance_values, 12);
+    put_dht(jpeg, 0x10, std_ac_luminance_nrcodes, std_ac_luminance_values, 162);
+    put_dht(jpeg, 0x01, std_dc_chrominance_nrcodes, std_dc_chrominance_values, 12);
+    put_dht(jpeg, 0x11, std_ac_chrominance_nrcodes, std_ac_chrominance_values, 162);
+
+    // SOS
+    put_marker(jpeg, 0xda, 12);
+    jpeg.insert(jpeg.end(), {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0});
+
+    static const HuffmanTable y_dc = build_huffman(std_dc_luminance_nrcodes, std_dc_luminance_values);
+    static const HuffmanTable y_ac = build_huffman(std_ac_luminance_nrcodes, std_ac_luminance_values);
+    static const HuffmanTable c_dc = build_huffman(std_dc_chrominance_nrcodes, std_dc_chrominance_values);
+    static const HuffmanTable c_ac = build_huffman(std_ac_chrominance_nrcodes, std_ac_chrominance_values);
+
+    // MCUs go out in raster order, MDEC macroblocks are stored column-major
+    BitWriter bits{jpeg};
+    int y_pred = 0, cb_pred = 0, cr_pred = 0;
+    for (int row = 0; row < mb_rows; row++)
+    {
+        for (int col = 0; col < mb_cols; col++)
+        {
+            const int16_t *mb = ctx.coefficients.data() + ((size_t)col * mb_rows + row) * 6 * 64;
+            for (int i = 0; i < 4; i++)
+                encode_block(bits, mb + (2 + i) * 64, y_dqt, y_pred, y_dc, y_ac);
+            encode_block(bits, mb + 1 * 64, c_dqt, cb_pred, c_dc, c_ac);
+            encode_block(bits, mb + 0 * 64, c_dqt, cr_pred, c_dc, c_ac);
+        }
+    }
+    bits.flush();
+
+    // EOI
+    jpeg.insert(jpeg.end(), {0xff, 0xd9});
+    return mb_decoded;
+}
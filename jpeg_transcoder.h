@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mdec.h"
+
+// Transcode an MDEC image to a baseline JFIF JPEG without leaving the DCT domain. MDEC data is
+// already 8x8 DCT coefficients in 4:2:0 with JPEG-style scaling, so the dequantised values from
+// rle_decode are requantised against an emitted DQT (the MDEC tables at the image's most common
+// q_scale, DC kept exact) and Huffman-coded with the standard tables. No IDCT, colour conversion
+// or forward DCT runs, and coefficients that divide evenly survive without generation loss.
+// Returns the number of macroblocks read from the stream.
+size_t transcode_mdec_to_jpeg(MdecContext &ctx, uint16_t **data, uint16_t *end, int width, int height,
+                              std::vector<uint8_t> &jpeg);
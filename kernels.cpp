@@ -0,0 +1,197 @@
+#include "kernels.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "mdec.h"
+
+const IdctKernel idct_kernels[] = {
+    {"idct_core", idct_reference, 0, INFINITY},
+    {"idct_aan_float", idct_aan_float, 1, 90.0},
+    {"idct_aan_fixed", idct_aan_fixed, 4, 65.0},
+    {"idct_scale_table", idct_scale_table, 48, 15.0},
+};
+const size_t idct_kernel_count = sizeof(idct_kernels) / sizeof(idct_kernels[0]);
+
+const ColorKernel color_kernels[] = {
+    {"yuv_to_rgb", yuv_to_rgb, 0, INFINITY},
+    {"yuv_to_rgb_fixed", yuv_to_rgb_fixed, 1, 90.0},
+};
+const size_t color_kernel_count = sizeof(color_kernels) / sizeof(color_kernels[0]);
+
+void idct_reference(const int16_t coefficients[64], int16_t dst[8][8])
+{
+    int16_t src[8][8];
+    for (int i = 0; i < 64; i++)
+        src[i / 8][i % 8] = (int16_t)((double)coefficients[i] * scalezag_natural[i]);
+    idct_core(src, dst);
+}
+
+void idct_aan_float(const int16_t coefficients[64], int16_t dst[8][8])
+{
+    float buffers[2][8][8];
+    for (int i = 0; i < 64; i++)
+        buffers[0][i / 8][i % 8] = (float)(int16_t)((double)coefficients[i] * scalezag_natural[i]);
+
+    // Like idct_core, each pass reads columns and writes rows, truncating to integers
+    for (int pass = 0; pass < 2; pass++)
+    {
+        float(*src)[8] = buffers[pass];
+        float out[8][8];
+        for (int i = 0; i < 8; i++)
+        {
+            float z10 = src[0][i] + src[4][i];
+            float z11 = src[0][i] - src[4][i];
+            float z13 = src[2][i] + src[6][i];
+            float z12 = 1.414213562f * (src[2][i] - src[6][i]) - z13;
+
+            float tmp0 = z10 + z13, tmp3 = z10 - z13;
+            float tmp1 = z11 + z12, tmp2 = z11 - z12;
+
+            z13 = src[3][i] + src[5][i];
+            z10 = src[3][i] - src[5][i];
+            float z11b = src[1][i] + src[7][i];
+            z12 = src[1][i] - src[7][i];
+
+            float z5 = 1.847759065f * (z12 - z10);
+            float tmp7 = z11b + z13;
+            float tmp6 = 2.613125930f * z10 + z5 - tmp7;
+            float tmp5 = 1.414213562f * (z11b - z13) - tmp6;
+            float tmp4 = 1.082392200f * z12 - z5 + tmp5;
+
+            out[i][0] = (float)(int16_t)(tmp0 + tmp7);
+            out[i][7] = (float)(int16_t)(tmp0 - tmp7);
+            out[i][1] = (float)(int16_t)(tmp1 + tmp6);
+            out[i][6] = (float)(int16_t)(tmp1 - tmp6);
+            out[i][2] = (float)(int16_t)(tmp2 + tmp5);
+            out[i][5] = (float)(int16_t)(tmp2 - tmp5);
+            out[i][4] = (float)(int16_t)(tmp3 + tmp4);
+            out[i][3] = (float)(int16_t)(tmp3 - tmp4);
+        }
+        if (pass == 0)
+            memcpy(buffers[1], out, sizeof(out));
+        else
+            for (int y = 0; y < 8; y++)
+                for (int x = 0; x < 8; x++)
+                    dst[y][x] = (int16_t)out[y][x];
+    }
+}
+
+// Fixed-point helpers: values carry FRAC fraction bits, constants are Q13
+static const int FRAC = 8;
+static inline int32_t fixed_mul(int32_t constant, int32_t value)
+{
+    return (int32_t)(((int64_t)constant * value + (1 << 12)) >> 13);
+}
+
+// Drop the fraction bits rounding toward zero, like the reference's double to int16 cast
+static inline int32_t fixed_trunc(int32_t value)
+{
+    return (value + (value < 0 ? (1 << FRAC) - 1 : 0)) >> FRAC;
+}
+
+void idct_aan_fixed(const int16_t coefficients[64], int16_t dst[8][8])
+{
+    const int32_t c1_414 = 11585; // 1.414213562 * 8192
+    const int32_t c1_848 = 15137; // 1.847759065
+    const int32_t c2_613 = 21407; // 2.613125930
+    const int32_t c1_082 = 8867;  // 1.082392200
+
+    // Prescale in Q32, truncating toward zero like the reference's double to int16 cast
+    int32_t src[8][8], out[8][8];
+    for (int i = 0; i < 64; i++)
+    {
+        int64_t scaled = (int64_t)coefficients[i] * scalezag_natural_fixed[i];
+        src[i / 8][i % 8] = (int16_t)((scaled + ((scaled >> 63) & 0xffffffffll)) >> SCALEZAG_FIXED_BITS);
+    }
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            int32_t s[8];
+            for (int r = 0; r < 8; r++)
+                s[r] = src[r][i] << FRAC;
+
+            int32_t z10 = s[0] + s[4], z11 = s[0] - s[4];
+            int32_t z13 = s[2] + s[6];
+            int32_t z12 = fixed_mul(c1_414, s[2] - s[6]) - z13;
+
+            int32_t tmp0 = z10 + z13, tmp3 = z10 - z13;
+            int32_t tmp1 = z11 + z12, tmp2 = z11 - z12;
+
+            z13 = s[3] + s[5];
+            z10 = s[3] - s[5];
+            z11 = s[1] + s[7];
+            z12 = s[1] - s[7];
+
+            int32_t z5 = fixed_mul(c1_848, z12 - z10);
+            int32_t tmp7 = z11 + z13;
+            int32_t tmp6 = fixed_mul(c2_613, z10) + z5 - tmp7;
+            int32_t tmp5 = fixed_mul(c1_414, z11 - z13) - tmp6;
+            int32_t tmp4 = fixed_mul(c1_082, z12) - z5 + tmp5;
+
+            out[i][0] = (int16_t)fixed_trunc(tmp0 + tmp7);
+            out[i][7] = (int16_t)fixed_trunc(tmp0 - tmp7);
+            out[i][1] = (int16_t)fixed_trunc(tmp1 + tmp6);
+            out[i][6] = (int16_t)fixed_trunc(tmp1 - tmp6);
+            out[i][2] = (int16_t)fixed_trunc(tmp2 + tmp5);
+            out[i][5] = (int16_t)fixed_trunc(tmp2 - tmp5);
+            out[i][4] = (int16_t)fixed_trunc(tmp3 + tmp4);
+            out[i][3] = (int16_t)fixed_trunc(tmp3 - tmp4);
+        }
+        memcpy(src, out, sizeof(out));
+    }
+
+    for (int y = 0; y < 8; y++)
+        for (int x = 0; x < 8; x++)
+            dst[y][x] = (int16_t)out[y][x];
+}
+
+void idct_scale_table(const int16_t coefficients[64], int16_t dst[8][8])
+{
+    int32_t buffers[2][64];
+    for (int i = 0; i < 64; i++)
+        buffers[0][i] = coefficients[i];
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        const int32_t *src = buffers[pass];
+        int32_t *out = buffers[pass ^ 1];
+        for (int x = 0; x < 8; x++)
+        {
+            for (int y = 0; y < 8; y++)
+            {
+                int64_t sum = 0;
+                for (int z = 0; z < 8; z++)
+                    sum += (int64_t)src[y + z * 8] * scale_table_transposed[x * 8 + z];
+                out[x + y * 8] = (int32_t)((sum + 0xfff) >> 13);
+            }
+        }
+    }
+
+    for (int i = 0; i < 64; i++)
+        dst[i / 8][i % 8] = (int16_t)buffers[0][i];
+}
+
+void yuv_to_rgb_fixed(int16_t yBlk[8][8], int16_t cbBlk[8][8], int16_t crBlk[8][8],
+                      uint8_t xx, uint8_t yy, uint8_t xOff, uint8_t yOff,
+                      uint8_t *dst, int stride)
+{
+    // The reference's coefficients are exact decimals, so scaling everything by 10^4 keeps the
+    // sums exact, and integer division truncates toward zero like the double to int32 cast
+    for (int y = 0; y < 8; y++)
+    {
+        for (int x = 0; x < 8; x++)
+        {
+            int32_t Y = yBlk[y][x] * 10000;
+            int32_t Cb = cbBlk[(y + yOff) / 2][(x + xOff) / 2];
+            int32_t Cr = crBlk[(y + yOff) / 2][(x + xOff) / 2];
+
+            int offset = (y + yy + yOff) * stride * 3 + (x + xx + xOff) * 3;
+            dst[offset] = sign_extend_9bits_clamp_8bits((Y + 14020 * Cr) / 10000) ^ 0x80;
+            dst[offset + 1] = sign_extend_9bits_clamp_8bits((Y - 3437 * Cb - 7143 * Cr) / 10000) ^ 0x80;
+            dst[offset + 2] = sign_extend_9bits_clamp_8bits((Y + 17720 * Cb) / 10000) ^ 0x80;
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Alternative IDCT and colour conversion kernels. None is used by the decoder yet: each has to
+// match the reference (idct_core on scalezag-prescaled input, yuv_to_rgb) within its tolerance
+// in mdec_verify before it may replace the reference in production.
+
+// Dequantised coefficients in natural order (rle_decode with prescale = false) to 8x8 pixels
+// (before the 9-bit clamp). Kernels that expect AAN-prescaled input apply scalezag themselves.
+typedef void (*IdctFunction)(const int16_t coefficients[64], int16_t dst[8][8]);
+
+// Same contract as yuv_to_rgb
+typedef void (*ColorFunction)(int16_t yBlk[8][8], int16_t cbBlk[8][8], int16_t crBlk[8][8],
+                              uint8_t xx, uint8_t yy, uint8_t xOff, uint8_t yOff,
+                              uint8_t *dst, int stride);
+
+// Budgets are regression limits: max_error applies to raw kernel output on the synthetic block
+// and colour sweeps, min_psnr to whole decoded images (where a one-step difference at the
+// 9-bit wrap can flip a pixel between black and white)
+struct IdctKernel
+{
+    const char *name;
+    IdctFunction idct;
+    int max_error;
+    double min_psnr;
+};
+
+struct ColorKernel
+{
+    const char *name;
+    ColorFunction convert;
+    int max_error;
+    double min_psnr;
+};
+
+// The first entry of each list is the reference
+extern const IdctKernel idct_kernels[];
+extern const size_t idct_kernel_count;
+extern const ColorKernel color_kernels[];
+extern const size_t color_kernel_count;
+
+// Reference: prescale exactly as rle_decode does, then idct_core
+void idct_reference(const int16_t coefficients[64], int16_t dst[8][8]);
+
+// idct_core's AAN flow graph in single precision
+void idct_aan_float(const int16_t coefficients[64], int16_t dst[8][8]);
+
+// idct_core's AAN flow graph in 32-bit fixed point (Q13 constants, 8 fraction bits)
+void idct_aan_fixed(const int16_t coefficients[64], int16_t dst[8][8]);
+
+// Matrix IDCT over scale_table as the PSX MDEC does it (psx-spx real_idct_core), on
+// unscaled coefficients. Closer to a true IDCT than idct_core, which truncates the prescaled
+// high-frequency coefficients to integers, so its budget mostly measures the reference's error.
+void idct_scale_table(const int16_t coefficients[64], int16_t dst[8][8]);
+
+// yuv_to_rgb in exact integer arithmetic; differs only where the reference's double rounding
+// lands just below an exact integer
+void yuv_to_rgb_fixed(int16_t yBlk[8][8], int16_t cbBlk[8][8], int16_t crBlk[8][8],
+                      uint8_t xx, uint8_t yy, uint8_t xOff, uint8_t yOff,
+                      uint8_t *dst, int stride);
@@ -0,0 +1,53 @@
+#include "macroblock_cache.h"
+
+#include <cstring>
+
+static const size_t macroblock_bytes = 16 * 16 * 3;
+
+MacroblockCache::MacroblockCache(int capacity_log2)
+    : mask_(((size_t)1 << capacity_log2) - 1),
+      keys_((size_t)1 << capacity_log2, Key{0, 0, 0}),
+      pixels_(((size_t)1 << capacity_log2) * macroblock_bytes)
+{
+}
+
+const uint8_t *MacroblockCache::find(uint64_t key, uint32_t words)
+{
+    key |= key == 0; // 0 marks an empty slot
+    lookups++;
+
+    for (int i = 0; i < max_probe; i++)
+    {
+        size_t slot = (key + i) & mask_;
+        if (keys_[slot].hash == 0)
+            return nullptr;
+        if (keys_[slot].hash == key && keys_[slot].words == words)
+        {
+            hits++;
+            return pixels_.data() + slot * macroblock_bytes;
+        }
+    }
+    return nullptr;
+}
+
+void MacroblockCache::insert(uint64_t key, uint32_t words, const uint8_t *rgb, int stride)
+{
+    key |= key == 0;
+
+    // First free slot in the probe run, otherwise evict the home slot
+    size_t slot = key & mask_;
+    for (int i = 0; i < max_probe; i++)
+    {
+        size_t s = (key + i) & mask_;
+        if (keys_[s].hash == 0)
+        {
+            slot = s;
+            break;
+        }
+    }
+
+    keys_[slot] = Key{key, words, 0};
+    uint8_t *dst = pixels_.data() + slot * macroblock_bytes;
+    for (int y = 0; y < 16; y++)
+        memcpy(dst + y * 16 * 3, rgb + y * stride, 16 * 3);
+}
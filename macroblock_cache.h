@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed-size, open-addressed cache from the hash of a macroblock's six compressed blocks to
+// its decoded 16x16 RGB pixels. Keys live in their own array so probing only touches one
+// cache line per few slots; pixels are stored separately and only read on a hit. Entries are
+// matched on the 64-bit hash plus the compressed length.
+class MacroblockCache
+{
+public:
+    explicit MacroblockCache(int capacity_log2 = 12);
+
+    // Decoded pixels (16 * 16 * 3 bytes, packed) for key, or null
+    const uint8_t *find(uint64_t key, uint32_t words);
+
+    // Store the 16x16 block at rgb (stride in bytes), replacing an entry if the probe run is full
+    void insert(uint64_t key, uint32_t words, const uint8_t *rgb, int stride);
+
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+
+private:
+    static const int max_probe = 8;
+
+    struct Key
+    {
+        uint64_t hash; // 0 = empty
+        uint32_t words;
+        uint32_t pad;
+    };
+
+    size_t mask_;
+    std::vector<Key> keys_;
+    std::vector<uint8_t> pixels_;
+};
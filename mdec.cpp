@@ -0,0 +1,731 @@
+#include "mdec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "hash.h"
+#include "trace.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MDEC_HAVE_SSE2 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Quantization tables for Y and Cr/Cb
+const uint8_t y_quant_table[64] = {
+    2, 16, 19, 22, 26, 27, 29, 34,
+    16, 16, 22, 24, 27, 29, 34, 37,
+    19, 22, 26, 27, 29, 34, 34, 38,
+    22, 22, 26, 27, 29, 34, 37, 40,
+    22, 26, 27, 29, 32, 35, 40, 48,
+    26, 27, 29, 32, 35, 40, 48, 58,
+    26, 27, 29, 34, 38, 46, 56, 69,
+    27, 29, 35, 38, 46, 56, 69, 83};
+
+const uint8_t c_quant_table[64] = {
+    2, 16, 19, 22, 26, 27, 29, 34,
+    16, 16, 22, 24, 27, 29, 34, 37,
+    19, 22, 26, 27, 29, 34, 34, 38,
+    22, 22, 26, 27, 29, 34, 37, 40,
+    22, 26, 27, 29, 32, 35, 40, 48,
+    26, 27, 29, 32, 35, 40, 48, 58,
+    26, 27, 29, 34, 38, 46, 56, 69,
+    27, 29, 35, 38, 46, 56, 69, 83};
+
+// Perform IDCT on 8x8 block
+void idct_core(int16_t src[8][8], int16_t dst[8][8])
+{
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            // Quick fill if AC coefficients are zero
+            if (src[1][i] == 0 && src[2][i] == 0 && src[3][i] == 0 &&
+                src[4][i] == 0 && src[5][i] == 0 && src[6][i] == 0 && src[7][i] == 0)
+            {
+                for (int j = 0; j < 8; j++)
+                    dst[i][j] = src[0][i];
+            }
+            else
+            {
+                double z10, z11, z12, z13, tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+
+                z10 = (double)src[0][i] + src[4][i];
+                z11 = (double)src[0][i] - src[4][i];
+                z13 = (double)src[2][i] + src[6][i];
+                z12 = (double)src[2][i] - src[6][i];
+
+                z12 = (1.414213562 * z12) - z13;
+
+                tmp0 = z10 + z13;
+                tmp3 = z10 - z13;
+                tmp1 = z11 + z12;
+                tmp2 = z11 - z12;
+
+                z13 = (double)src[3][i] + src[5][i];
+                z10 = (double)src[3][i] - src[5][i];
+                z11 = (double)src[1][i] + src[7][i];
+                z12 = (double)src[1][i] - src[7][i];
+
+                double z5 = 1.847759065 * (z12 - z10);
+
+                tmp7 = z11 + z13;
+                tmp6 = (2.613125930 * z10) + z5 - tmp7;
+                tmp5 = (1.414213562 * (z11 - z13)) - tmp6;
+                tmp4 = (1.082392200 * z12) - z5 + tmp5;
+
+                dst[i][0] = (int16_t)(tmp0 + tmp7);
+                dst[i][7] = (int16_t)(tmp0 - tmp7);
+                dst[i][1] = (int16_t)(tmp1 + tmp6);
+                dst[i][6] = (int16_t)(tmp1 - tmp6);
+                dst[i][2] = (int16_t)(tmp2 + tmp5);
+                dst[i][5] = (int16_t)(tmp2 - tmp5);
+                dst[i][4] = (int16_t)(tmp3 + tmp4);
+                dst[i][3] = (int16_t)(tmp3 - tmp4);
+            }
+        }
+
+        if (pass == 0)
+            for (int j = 0; j < 8; j++)
+                std::swap(src[j], dst[j]);
+    }
+}
+
+int16_t quantize_dc(uint16_t val, uint8_t quant)
+{
+    int16_t _val = (int16_t)(val << 6) >> 6;
+    int32_t c;
+    if (quant == 0)
+        c = (int32_t)_val << 1;
+    else
+        c = (int32_t)_val * (int32_t)quant;
+    return (int16_t)std::min(std::max(c, -0x4000), 0x3fff);
+}
+
+// AC level times factor = quant * q_scale (MdecQuantTables::ac_factors)
+static inline int16_t quantize_ac_factor(uint16_t val, int32_t factor)
+{
+    int16_t _val = (int16_t)(val << 6) >> 6;
+    int32_t c;
+    if (factor == 0)
+        c = (int32_t)_val << 1;
+    else
+        c = ((int32_t)_val * factor + 4) >> 3;
+    return (int16_t)std::min(std::max(c, -0x4000), 0x3fff);
+}
+
+int16_t quantize_ac(uint16_t val, uint8_t quant, uint8_t qScale)
+{
+    return quantize_ac_factor(val, (int32_t)quant * (int32_t)qScale);
+}
+
+// Dequantise the AC word val at zigzag position k, factors being the row of ac_factors for the
+// block's table and q_scale
+static inline int16_t dequantize_ac(uint16_t val, int k, const uint16_t *factors, bool prescale)
+{
+    int16_t c = quantize_ac_factor(val, factors[k]);
+    // Multiplying by scalezag_natural_fixed instead is no faster here and rounds a few
+    // coefficients differently, so the double product stays the reference
+    return prescale ? (int16_t)((double)c * scalezag[k]) : c;
+}
+
+// Reference AC loop, one word at a time from zigzag position k. Right after the DC word the
+// first AC word is read without a bounds check (checked = false). Returns the levels stored.
+static int rle_decode_ac_scalar(uint16_t **data, uint16_t *end, int16_t *blk, int k, const uint16_t *factors,
+                                bool prescale, bool checked)
+{
+    int levels = 0;
+    if (checked && *data >= end)
+        return 0;
+    uint16_t n = *(*data)++;
+    while (true)
+    {
+        // Get run length
+        k += (n >> 10) & 0x3f;
+        if (k >= 64)
+            break;
+
+        // Apply quantization and scaling
+        blk[zagzig[k]] = dequantize_ac(n & 0x3ff, k, factors, prescale);
+        levels++;
+
+        // Get next code (a block cut off by the end of the data ends here)
+        if (++k >= 64 || *data >= end)
+            break;
+        n = *(*data)++;
+
+        // Check for end of block
+        if (n == 0xfe00)
+            break;
+    }
+    return levels;
+}
+
+#ifdef MDEC_HAVE_SSE2
+static inline int lowest_set_bit(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Eight AC words at a time. Their zigzag positions are a prefix sum of run + 1, and the block
+// ends at the first word whose position reaches 63 (stored, then stop) or passes it (consumed
+// but not stored; 0xfe00 always does, its run being 63). That replaces the per-word branches of
+// the scalar loop with one compare mask per eight words; only the dequantise and scatter of the
+// levels stay scalar. Fewer than eight words left go through the scalar loop.
+static int rle_decode_ac_sse2(uint16_t **data, uint16_t *end, int16_t *blk, const uint16_t *factors, bool prescale)
+{
+    // DC-only blocks, common in flat areas, end on their first AC word
+    if (end - *data >= 8 && **data == 0xfe00)
+    {
+        (*data)++;
+        return 0;
+    }
+
+    int k = 1;
+    int levels = 0;
+    bool checked = false;
+    while (end - *data >= 8)
+    {
+        const uint16_t *words = *data;
+        __m128i steps = _mm_add_epi16(_mm_srli_epi16(_mm_loadu_si128((const __m128i *)words), 10), _mm_set1_epi16(1));
+        steps = _mm_add_epi16(steps, _mm_slli_si128(steps, 2));
+        steps = _mm_add_epi16(steps, _mm_slli_si128(steps, 4));
+        steps = _mm_add_epi16(steps, _mm_slli_si128(steps, 8));
+        __m128i positions = _mm_add_epi16(steps, _mm_set1_epi16((int16_t)(k - 1)));
+        int stop = _mm_movemask_epi8(_mm_cmpgt_epi16(positions, _mm_set1_epi16(62)));
+
+        alignas(16) uint16_t pos[8];
+        _mm_store_si128((__m128i *)pos, positions);
+        int count = stop ? lowest_set_bit((unsigned)stop) / 2 : 8;
+
+        for (int i = 0; i < count; i++)
+            blk[zagzig[pos[i]]] = dequantize_ac(words[i] & 0x3ff, pos[i], factors, prescale);
+        levels += count;
+        if (count < 8)
+        {
+            if (pos[count] == 63)
+            {
+                blk[zagzig[63]] = dequantize_ac(words[count] & 0x3ff, 63, factors, prescale);
+                levels++;
+            }
+            *data += count + 1;
+            return levels;
+        }
+        *data += 8;
+        k = pos[7] + 1;
+        checked = true;
+    }
+    return levels + rle_decode_ac_scalar(data, end, blk, k, factors, prescale, checked);
+}
+#endif
+
+// Decode RLE data to block
+void rle_decode(MdecContext &ctx, uint16_t **data, int16_t *blk, MdecBlockType block_type, uint16_t *end,
+                bool prescale)
+{
+    // Select quantization table based on block type
+    bool luma = block_type == MDEC_BLOCK_Y;
+    const uint8_t *qt = ctx.quant->table(luma);
+
+    // Initialize block to zeros
+    for (int i = 0; i < 64; i++)
+        blk[i] = 0;
+
+    if (*data >= end)
+    {
+        ctx.early_terminate = true;
+        return;
+    }
+
+    // Look for start of block (skip FE00 markers)
+    uint16_t *block_start = *data;
+    uint16_t n = *(*data)++;
+    while (n == 0xfe00 && *data < end)
+        n = *(*data)++;
+    MDEC_STATS_ADD(ctx.stats, padding_words, *data - block_start - 1);
+
+    if (*data >= end)
+    {
+        ctx.early_terminate = true;
+        return;
+    }
+
+    // Extract q_scale and DC value
+    uint8_t q_scale = (n >> 10) & 0x3f;
+    ctx.q_scale = q_scale;
+    uint16_t val = n & 0x3ff;
+
+    // Store DC value
+    blk[zagzig[0]] = prescale ? (int16_t)((double)quantize_dc(val, qt[0]) * scalezag[0]) : quantize_dc(val, qt[0]);
+
+    // Process AC coefficients
+    const uint16_t *factors = ctx.quant->factors(luma, q_scale);
+    int levels;
+#ifdef MDEC_HAVE_SSE2
+    if (!ctx.scalar_rle)
+        levels = rle_decode_ac_sse2(data, end, blk, factors, prescale);
+    else
+#endif
+        levels = rle_decode_ac_scalar(data, end, blk, 1, factors, prescale, false);
+    (void)levels;
+
+    MDEC_STATS_ADD(ctx.stats, blocks, 1);
+    MDEC_STATS_ADD(ctx.stats, dc_only_blocks, levels == 0);
+    MDEC_STATS_ADD(ctx.stats, nonzero_coefficients, levels);
+}
+
+// Process a single 8x8 block
+void process_mdec_block(MdecContext &ctx, uint16_t **rle_data, int16_t output[8][8],
+                        MdecBlockType block_type, uint16_t *end)
+{
+    int16_t rle_decoded[64] = {0};
+    int16_t dct_block[8][8] = {0};
+
+    // Decode RLE data
+    {
+        MDEC_STAGE_TIMER(ctx.stats, MDEC_STAGE_RLE);
+        rle_decode(ctx, rle_data, rle_decoded, block_type, end);
+    }
+
+    // Convert 1D array to 8x8 block
+    for (int i = 0; i < 8; i++)
+        for (int j = 0; j < 8; j++)
+            dct_block[i][j] = rle_decoded[i * 8 + j];
+
+    // Apply IDCT
+    MDEC_STAGE_TIMER(ctx.stats, MDEC_STAGE_IDCT);
+    idct_core(dct_block, output);
+}
+
+int8_t sign_extend_9bits_clamp_8bits(int32_t val)
+{
+    int16_t signed_val = static_cast<int16_t>(static_cast<uint16_t>(val) << 7) >> 7;
+    return (int8_t)std::min(std::max(signed_val, (int16_t)-128), (int16_t)127);
+}
+
+// Convert YUV to RGB
+void yuv_to_rgb(int16_t yBlk[8][8], int16_t cbBlk[8][8], int16_t crBlk[8][8],
+                uint8_t xx, uint8_t yy, uint8_t xOff, uint8_t yOff,
+                uint8_t *dst, int stride)
+{
+    for (int y = 0; y < 8; y++)
+    {
+        for (int x = 0; x < 8; x++)
+        {
+            int32_t Y = yBlk[y][x];
+
+            // Calculate chroma indices based on offsets and ensure they're within 4x4 region
+            int cb_x = (x + xOff) / 2;
+            int cb_y = (y + yOff) / 2;
+            int32_t Cb = cbBlk[cb_y][cb_x]; // Chroma at half resolution with proper offset
+            int32_t Cr = crBlk[cb_y][cb_x];
+
+            // Calculate RGB values
+            int32_t R = (int32_t)(Y + (1.402 * Cr));
+            int32_t G = (int32_t)(Y + (-0.3437 * Cb) + (-0.7143 * Cr));
+            int32_t B = (int32_t)(Y + (1.772 * Cb));
+
+            // Store RGB values in output buffer
+            int offset = (y + yy + yOff) * stride * 3 + (x + xx + xOff) * 3;
+            dst[offset] = sign_extend_9bits_clamp_8bits(R) ^ 0x80;
+            dst[offset + 1] = sign_extend_9bits_clamp_8bits(G) ^ 0x80;
+            dst[offset + 2] = sign_extend_9bits_clamp_8bits(B) ^ 0x80;
+        }
+    }
+}
+
+// Decode the six blocks of a macroblock and convert them to RGB
+static void decode_macroblock(MdecContext &ctx, uint16_t **rle_data, uint8_t *output_image, uint16_t *end,
+                              int image_width, int mb_x, int mb_y)
+{
+    int16_t y_blocks[4][8][8];
+    int16_t cb_block[8][8];
+    int16_t cr_block[8][8];
+
+    // Process Cr block (chrominance red)
+    process_mdec_block(ctx, rle_data, cr_block, MDEC_BLOCK_CR, end);
+
+    // Process Cb block (chrominance blue)
+    process_mdec_block(ctx, rle_data, cb_block, MDEC_BLOCK_CB, end);
+
+    // Process Y blocks (luminance)
+    for (int i = 0; i < 4; i++)
+        process_mdec_block(ctx, rle_data, y_blocks[i], MDEC_BLOCK_Y, end);
+
+    // Convert YUV to RGB for each 8x8 block within the macroblock
+    MDEC_STAGE_TIMER(ctx.stats, MDEC_STAGE_COLOR);
+    yuv_to_rgb(y_blocks[0], cb_block, cr_block, mb_x, mb_y, 0, 0, output_image, image_width);
+    yuv_to_rgb(y_blocks[1], cb_block, cr_block, mb_x, mb_y, 8, 0, output_image, image_width); // Order differs from PSX-SPX ???
+    yuv_to_rgb(y_blocks[2], cb_block, cr_block, mb_x, mb_y, 0, 8, output_image, image_width);
+    yuv_to_rgb(y_blocks[3], cb_block, cr_block, mb_x, mb_y, 8, 8, output_image, image_width);
+}
+
+// Process a 16x16 macroblock
+void process_macroblock(MdecContext &ctx, uint16_t **rle_data, uint8_t *output_image, uint16_t *end,
+                        int image_width, int mb_x, int mb_y)
+{
+    MacroblockCache *cache = ctx.macroblock_cache.get();
+    if (cache)
+    {
+        // Key on the compressed words of all six blocks and the quantisation tables; a truncated
+        // macroblock is never cached
+        uint16_t *mb_start = *rle_data;
+        uint16_t *mb_end = mb_start;
+        if (skip_mdec_macroblocks(&mb_end, end, 1) == 1)
+        {
+            uint32_t words = (uint32_t)(mb_end - mb_start);
+            uint64_t key = mdec_hash64(mb_start, words * sizeof(uint16_t), ctx.quant->hash);
+            uint8_t *dst = output_image + (mb_y * image_width + mb_x) * 3;
+
+            if (const uint8_t *pixels = cache->find(key, words))
+            {
+                for (int y = 0; y < 16; y++)
+                    memcpy(dst + y * image_width * 3, pixels + y * 16 * 3, 16 * 3);
+                *rle_data = mb_end;
+                return;
+            }
+
+            decode_macroblock(ctx, rle_data, output_image, end, image_width, mb_x, mb_y);
+            cache->insert(key, words, dst, image_width * 3);
+            return;
+        }
+    }
+
+    decode_macroblock(ctx, rle_data, output_image, end, image_width, mb_x, mb_y);
+}
+
+int mdec_pixel_size(MdecPixelFormat format)
+{
+    return format == MDEC_PIXEL_FORMAT_RGBA32 || format == MDEC_PIXEL_FORMAT_BGRA32 ? 4 : 3;
+}
+
+// Convert one row of a packed RGB24 patch to the output format
+template <MdecPixelFormat Format>
+static inline void store_row(const uint8_t *src, uint8_t *row, int columns)
+{
+    if constexpr (Format == MDEC_PIXEL_FORMAT_RGB24)
+        memcpy(row, src, columns * 3);
+    else if constexpr (Format == MDEC_PIXEL_FORMAT_BGR24)
+    {
+        for (int x = 0; x < columns; x++)
+        {
+            row[x * 3] = src[x * 3 + 2];
+            row[x * 3 + 1] = src[x * 3 + 1];
+            row[x * 3 + 2] = src[x * 3];
+        }
+    }
+    else
+    {
+        constexpr int r = Format == MDEC_PIXEL_FORMAT_RGBA32 ? 0 : 2;
+        for (int x = 0; x < columns; x++)
+        {
+            row[x * 4 + r] = src[x * 3];
+            row[x * 4 + 1] = src[x * 3 + 1];
+            row[x * 4 + (2 - r)] = src[x * 3 + 2];
+            row[x * 4 + 3] = 0xff;
+        }
+    }
+}
+
+// Copy the visible part of a packed RGB24 patch into the output in the requested format
+static void store_patch(const uint8_t *patch, int columns, int rows, uint8_t *dst, size_t stride,
+                        MdecPixelFormat format)
+{
+    for (int y = 0; y < rows; y++)
+    {
+        const uint8_t *src = patch + y * 16 * 3;
+        uint8_t *row = dst + y * stride;
+        switch (format)
+        {
+        case MDEC_PIXEL_FORMAT_RGB24:
+            store_row<MDEC_PIXEL_FORMAT_RGB24>(src, row, columns);
+            break;
+        case MDEC_PIXEL_FORMAT_BGR24:
+            store_row<MDEC_PIXEL_FORMAT_BGR24>(src, row, columns);
+            break;
+        case MDEC_PIXEL_FORMAT_RGBA32:
+            store_row<MDEC_PIXEL_FORMAT_RGBA32>(src, row, columns);
+            break;
+        case MDEC_PIXEL_FORMAT_BGRA32:
+            store_row<MDEC_PIXEL_FORMAT_BGRA32>(src, row, columns);
+            break;
+        }
+    }
+}
+
+// Reconstruct the image from patches stored column-major, clipping those that overhang the
+// right or bottom edge
+static void reassemble_generic(const uint8_t *patches, size_t patch_count, int width, int height, uint8_t *output,
+                               size_t stride, MdecPixelFormat format)
+{
+    const size_t patch_size = 16 * 16 * 3;
+    size_t patches_per_column = (height + 15) / 16;
+    int pixel_size = mdec_pixel_size(format);
+    for (int i = 0; i < (int)patch_count; i++)
+    {
+        int patch_x = (int)(i / patches_per_column) * 16;
+        int patch_y = (int)(i % patches_per_column) * 16;
+        if (patch_x >= width)
+            break;
+        store_patch(patches + i * patch_size, std::min(16, width - patch_x), std::min(16, height - patch_y),
+                    output + patch_y * stride + patch_x * pixel_size, stride, format);
+    }
+}
+
+// The same with the size and format known at compile time: the macroblock grid, the edge
+// clipping and the per-row copy length are constants, so rows become fixed-size moves
+template <MdecPixelFormat Format, int Columns, int Rows>
+static inline void store_patch_fixed(const uint8_t *patch, uint8_t *dst, size_t stride)
+{
+    for (int y = 0; y < Rows; y++)
+        store_row<Format>(patch + y * 16 * 3, dst + y * stride, Columns);
+}
+
+template <int Width, int Height, MdecPixelFormat Format>
+static void reassemble_fixed(const uint8_t *patches, size_t patch_count, uint8_t *output, size_t stride)
+{
+    const size_t patch_size = 16 * 16 * 3;
+    constexpr int columns = (Width + 15) / 16;
+    constexpr int rows = (Height + 15) / 16;
+    constexpr int pixel_size = Format == MDEC_PIXEL_FORMAT_RGBA32 || Format == MDEC_PIXEL_FORMAT_BGRA32 ? 4 : 3;
+    constexpr int last_width = Width - (columns - 1) * 16;
+    constexpr int last_height = Height - (rows - 1) * 16;
+
+    size_t i = 0;
+    for (int column = 0; column < columns; column++)
+    {
+        for (int row = 0; row < rows; row++, i++)
+        {
+            if (i >= patch_count)
+                return;
+            const uint8_t *patch = patches + i * patch_size;
+            uint8_t *dst = output + row * 16 * stride + column * 16 * pixel_size;
+            bool right = column == columns - 1;
+            bool bottom = row == rows - 1;
+            if ((last_width == 16 || !right) && (last_height == 16 || !bottom))
+                store_patch_fixed<Format, 16, 16>(patch, dst, stride);
+            else if (!right)
+                store_patch_fixed<Format, 16, last_height>(patch, dst, stride);
+            else if (!bottom)
+                store_patch_fixed<Format, last_width, 16>(patch, dst, stride);
+            else
+                store_patch_fixed<Format, last_width, last_height>(patch, dst, stride);
+        }
+    }
+}
+
+using FixedReassembly = void (*)(const uint8_t *patches, size_t patch_count, uint8_t *output, size_t stride);
+
+struct FixedPipeline
+{
+    int width;
+    int height;
+    MdecPixelFormat format;
+    FixedReassembly reassemble;
+};
+
+#define MDEC_FIXED_PIPELINES(w, h)                                                        \
+    {w, h, MDEC_PIXEL_FORMAT_RGB24, reassemble_fixed<w, h, MDEC_PIXEL_FORMAT_RGB24>},     \
+        {w, h, MDEC_PIXEL_FORMAT_BGR24, reassemble_fixed<w, h, MDEC_PIXEL_FORMAT_BGR24>}, \
+        {w, h, MDEC_PIXEL_FORMAT_RGBA32, reassemble_fixed<w, h, MDEC_PIXEL_FORMAT_RGBA32>}, \
+        {w, h, MDEC_PIXEL_FORMAT_BGRA32, reassemble_fixed<w, h, MDEC_PIXEL_FORMAT_BGRA32>}
+
+// The common PS1 video and still resolutions
+static const FixedPipeline fixed_pipelines[] = {
+    MDEC_FIXED_PIPELINES(256, 192),
+    MDEC_FIXED_PIPELINES(320, 224),
+    MDEC_FIXED_PIPELINES(320, 240),
+    MDEC_FIXED_PIPELINES(640, 480),
+};
+
+static FixedReassembly find_fixed_reassembly(int width, int height, MdecPixelFormat format)
+{
+    for (const FixedPipeline &pipeline : fixed_pipelines)
+        if (pipeline.width == width && pipeline.height == height && pipeline.format == format)
+            return pipeline.reassemble;
+    return nullptr;
+}
+
+bool mdec_has_fixed_pipeline(int width, int height, MdecPixelFormat format)
+{
+    return find_fixed_reassembly(width, height, format) != nullptr;
+}
+
+// Decode every macroblock in [*data, end) into width * height pixels of the given format.
+// Macroblocks are stored column-major; patch memory is kept in ctx for reuse.
+size_t decode_mdec_frame(MdecContext &ctx, uint16_t **data, uint16_t *end, int width, int height,
+                         uint8_t *output_image, size_t stride, MdecPixelFormat format)
+{
+    const size_t patch_size = 16 * 16 * 3;
+
+    // Equal words only decode to equal pixels under the same quantisation tables
+    if (ctx.previous_frame_quant != ctx.quant)
+    {
+        ctx.previous_frame.clear();
+        ctx.previous_frame_quant = ctx.quant;
+    }
+
+    // Process macroblocks in column-major order
+    size_t patch_count = 0;
+    size_t patches_per_column = (height + 15) / 16; // Ensure proper handling of non-multiples of 16
+    bool tracing = trace_enabled();
+    uint64_t column_start = tracing ? trace_now() : 0;
+    size_t column = 0;
+    while (*data < end) // Decode image
+    {
+        // One trace span per macroblock column
+        if (tracing && patch_count / patches_per_column > column)
+        {
+            trace_span("mb column", column_start, column);
+            column = patch_count / patches_per_column;
+            column_start = trace_now();
+        }
+
+        if (ctx.patches.size() < (patch_count + 1) * patch_size)
+            ctx.patches.resize((patch_count + 1) * patch_size);
+
+        // The patch still holds the previous frame's pixels for this position, so identical
+        // compressed bytes need no decoding at all
+        uint16_t *mb_start = *data;
+        if (ctx.reuse_previous_frame && patch_count < ctx.previous_frame.size())
+        {
+            const MacroblockSpan &prev = ctx.previous_frame[patch_count];
+            if (prev.words && prev.count <= (size_t)(end - mb_start) &&
+                memcmp(prev.words, mb_start, prev.count * sizeof(uint16_t)) == 0)
+            {
+                // The next frame compares against these words, not the older frame's copy
+                ctx.previous_frame[patch_count].words = mb_start;
+                *data += prev.count;
+                ctx.previous_frame_hits++;
+                patch_count++;
+                continue;
+            }
+        }
+
+        ctx.early_terminate = false;
+        process_macroblock(ctx, data, ctx.patches.data() + patch_count * patch_size, end, 16, 0, 0);
+        if (!ctx.early_terminate)
+        {
+            if (ctx.reuse_previous_frame)
+            {
+                if (ctx.previous_frame.size() <= patch_count)
+                    ctx.previous_frame.resize(patch_count + 1);
+                ctx.previous_frame[patch_count] = {mb_start, (size_t)(*data - mb_start)};
+            }
+            patch_count++;
+        }
+    }
+
+    if (tracing && patch_count > column * patches_per_column)
+        trace_span("mb column", column_start, column);
+
+    // Spans past the last complete macroblock point into older frames, and a truncated
+    // macroblock left partial pixels in its patch: neither may be matched again
+    if (ctx.previous_frame.size() > patch_count)
+        ctx.previous_frame.resize(patch_count);
+
+    MDEC_STAGE_TIMER(ctx.stats, MDEC_STAGE_REASSEMBLY);
+    TraceScope trace("reassemble");
+    FixedReassembly fixed = ctx.generic_reassembly ? nullptr : find_fixed_reassembly(width, height, format);
+    if (fixed)
+        fixed(ctx.patches.data(), patch_count, output_image, stride);
+    else
+        reassemble_generic(ctx.patches.data(), patch_count, width, height, output_image, stride, format);
+    return patch_count;
+}
+
+size_t decode_mdec_mono_frame(MdecContext &ctx, uint16_t **data, uint16_t *end, int width, int height,
+                              uint8_t *output_image)
+{
+    size_t rows = (height + 7) / 8;
+    size_t total = rows * ((width + 7) / 8);
+    size_t blocks = 0;
+    while (*data < end && blocks < total)
+    {
+        int16_t block[8][8];
+        ctx.early_terminate = false;
+        process_mdec_block(ctx, data, block, MDEC_BLOCK_Y, end);
+        if (ctx.early_terminate)
+            break;
+
+        // Like the hardware: wrap and clamp to a signed byte, then offset to unsigned
+        int bx = (int)(blocks / rows) * 8, by = (int)(blocks % rows) * 8;
+        for (int y = 0; y < 8 && by + y < height; y++)
+            for (int x = 0; x < 8 && bx + x < width; x++)
+                output_image[(size_t)(by + y) * width + bx + x] =
+                    (uint8_t)(sign_extend_9bits_clamp_8bits(block[y][x]) ^ 0x80);
+        blocks++;
+    }
+    return blocks;
+}
+
+size_t decode_mdec_frame(MdecContext &ctx, uint16_t **data, uint16_t *end, int width, int height,
+                         uint8_t *output_image)
+{
+    return decode_mdec_frame(ctx, data, end, width, height, output_image, (size_t)width * 3,
+                             MDEC_PIXEL_FORMAT_RGB24);
+}
+
+bool skip_mdec_block(uint16_t **data, uint16_t *end)
+{
+    if (*data >= end)
+        return false;
+
+    // Skip FE00 markers before the DC word
+    uint16_t n = *(*data)++;
+    while (n == 0xfe00 && *data < end)
+        n = *(*data)++;
+
+    if (*data >= end)
+        return false;
+
+    // Walk the AC run lengths the same way rle_decode does
+    int k = 1;
+    n = *(*data)++;
+    while (true)
+    {
+        k += (n >> 10) & 0x3f;
+        if (k >= 64)
+            break;
+        k++;
+        if (k >= 64 || *data >= end)
+            break;
+        n = *(*data)++;
+        if (n == 0xfe00)
+            break;
+    }
+    return true;
+}
+
+size_t skip_mdec_macroblocks(uint16_t **data, uint16_t *end, size_t count)
+{
+    for (size_t mb = 0; mb < count; mb++)
+        for (int blk = 0; blk < 6; blk++)
+            if (!skip_mdec_block(data, end))
+                return mb;
+    return count;
+}
+
+bool read_mdec_file(const char *path, std::vector<uint16_t> &words)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+
+    // Get file size and allocate buffer
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    words.resize(size / sizeof(uint16_t));
+    return (bool)file.read(reinterpret_cast<char *>(words.data()), words.size() * sizeof(uint16_t));
+}
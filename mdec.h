@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "macroblock_cache.h"
+#include "mdec_tables.h"
+#include "quant_tables.h"
+#include "stats.h"
+
+// Bump whenever the decoded pixels change (IDCT, colour conversion, ...) so that outputs
+// cached under the previous behaviour are no longer served
+#define MDEC_DECODER_REVISION 1
+
+enum MdecBlockType
+{
+    MDEC_BLOCK_CR = 0,
+    MDEC_BLOCK_CB = 1,
+    MDEC_BLOCK_Y = 2
+};
+
+// Layout of decoded pixels written by decode_mdec_frame. The 32-bit formats store 0xff alpha.
+enum MdecPixelFormat
+{
+    MDEC_PIXEL_FORMAT_RGB24 = 0,
+    MDEC_PIXEL_FORMAT_BGR24 = 1,
+    MDEC_PIXEL_FORMAT_RGBA32 = 2,
+    MDEC_PIXEL_FORMAT_BGRA32 = 3
+};
+
+// Bytes per pixel of a pixel format
+int mdec_pixel_size(MdecPixelFormat format);
+
+// Zigzag tables: natural index of each zigzag position, and back
+inline constexpr std::array<uint8_t, 64> zagzig = make_zagzig();
+inline constexpr std::array<uint8_t, 64> zigzag = make_zigzag();
+
+// Standard quantization tables for Y and Cr/Cb (zigzag order); see quant_tables.h for others
+extern const uint8_t y_quant_table[64];
+extern const uint8_t c_quant_table[64];
+
+// IDCT scaling, see mdec_tables.h
+inline constexpr std::array<int16_t, 64> scale_table = make_scale_table();
+inline constexpr std::array<int16_t, 64> scale_table_transposed = make_scale_table_transposed();
+inline constexpr std::array<double, 8> scalefactor = make_scalefactor();
+inline constexpr std::array<double, 64> scalezag = make_scalezag();
+inline constexpr std::array<double, 64> scalezag_natural = make_scalezag_natural();
+inline constexpr std::array<uint32_t, 64> scalezag_natural_fixed = make_scalezag_natural_fixed();
+
+// Compressed words of one macroblock
+struct MacroblockSpan
+{
+    const uint16_t *words = nullptr;
+    size_t count = 0;
+};
+
+// Per-decoder state. Each thread decoding in parallel needs its own context; the scratch
+// buffers are kept between frames so a context reused across files does not reallocate.
+struct MdecContext
+{
+    bool early_terminate = false;
+    bool scalar_rle = false; // use the one-word-at-a-time RLE loop instead of SSE2, e.g. to verify it
+    bool generic_reassembly = false; // skip the fixed-resolution reassembly, e.g. to compare against it
+    uint8_t q_scale = 0; // of the last block rle_decode read
+
+    // Quantisation tables rle_decode dequantises with. Changing them between frames keeps the
+    // macroblock cache and previous-frame reuse correct: both are keyed on the tables too.
+    const MdecQuantTables *quant = mdec_default_quant_tables();
+    std::vector<uint8_t> patches;
+    std::vector<int16_t> coefficients; // scratch for coefficient-domain transcoding
+
+    // Optional cache of decoded macroblocks keyed by their compressed bytes
+    std::unique_ptr<MacroblockCache> macroblock_cache;
+
+    // For consecutive frames of one stream: skip a macroblock whose compressed bytes equal
+    // those at the same position in the previous frame decoded with this context. The input
+    // buffer of the previous frame must remain valid until the next frame has been decoded.
+    bool reuse_previous_frame = false;
+    std::vector<MacroblockSpan> previous_frame;
+    const MdecQuantTables *previous_frame_quant = nullptr; // tables previous_frame was decoded with
+    uint64_t previous_frame_hits = 0;
+
+    // When set, stage timings and block counters are added here (one MdecStats per thread)
+    MdecStats *stats = nullptr;
+};
+
+// Perform IDCT on 8x8 block
+void idct_core(int16_t src[8][8], int16_t dst[8][8]);
+
+int16_t quantize_dc(uint16_t val, uint8_t quant);
+int16_t quantize_ac(uint16_t val, uint8_t quant, uint8_t qScale);
+
+// Decode RLE data to block (natural order). With prescale the dequantised coefficients are
+// multiplied by scalezag for idct_core; without it they are plain JPEG-scaled DCT coefficients.
+void rle_decode(MdecContext &ctx, uint16_t **data, int16_t *blk, MdecBlockType block_type, uint16_t *end,
+                bool prescale = true);
+
+// Process a single 8x8 block
+void process_mdec_block(MdecContext &ctx, uint16_t **rle_data, int16_t output[8][8],
+                        MdecBlockType block_type, uint16_t *end);
+
+// Wrap to 9 bits, then clamp to a signed byte
+int8_t sign_extend_9bits_clamp_8bits(int32_t val);
+
+// Convert YUV to RGB
+void yuv_to_rgb(int16_t yBlk[8][8], int16_t cbBlk[8][8], int16_t crBlk[8][8],
+                uint8_t xx, uint8_t yy, uint8_t xOff, uint8_t yOff,
+                uint8_t *dst, int stride);
+
+// Process a 16x16 macroblock
+void process_macroblock(MdecContext &ctx, uint16_t **rle_data, uint8_t *output_image, uint16_t *end,
+                        int image_width, int mb_x, int mb_y);
+
+// Decode a whole image into an RGB24 framebuffer (width * height * 3 bytes).
+// Returns the number of macroblocks decoded.
+size_t decode_mdec_frame(MdecContext &ctx, uint16_t **data, uint16_t *end, int width, int height,
+                         uint8_t *output_image);
+
+// Decode a whole image into a caller-owned buffer of height rows, stride bytes apart
+size_t decode_mdec_frame(MdecContext &ctx, uint16_t **data, uint16_t *end, int width, int height,
+                         uint8_t *output_image, size_t stride, MdecPixelFormat format);
+
+// Decode a monochrome image: Y blocks only, each 8x8 pixels, stored column-major like colour
+// macroblocks (the MDEC's 4 and 8-bit output depths). Writes width * height grey bytes and
+// returns the number of blocks decoded.
+size_t decode_mdec_mono_frame(MdecContext &ctx, uint16_t **data, uint16_t *end, int width, int height,
+                              uint8_t *output_image);
+
+// Whether decode_mdec_frame has a reassembly specialised at compile time for this size and
+// format (256x192, 320x224, 320x240 and 640x480 in every format); others use the generic loop
+bool mdec_has_fixed_pipeline(int width, int height, MdecPixelFormat format);
+
+// Advance past one block without decoding it, consuming exactly the words rle_decode would.
+// Returns false (like early_terminate) if the data ends before a block starts.
+bool skip_mdec_block(uint16_t **data, uint16_t *end);
+
+// Advance past count macroblocks (six blocks each). Returns the number fully skipped.
+size_t skip_mdec_macroblocks(uint16_t **data, uint16_t *end, size_t count);
+
+// Read a raw MDEC RLE file into 16-bit words
+bool read_mdec_file(const char *path, std::vector<uint16_t> &words);
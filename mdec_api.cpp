@@ -0,0 +1,202 @@
+#include "mdec_api.h"
+
+#include <algorithm>
+#include <new>
+
+#include "mdec.h"
+#include "tiled_decoder.h"
+
+static_assert((int)MDEC_PIXEL_RGB24 == MDEC_PIXEL_FORMAT_RGB24 && (int)MDEC_PIXEL_BGR24 == MDEC_PIXEL_FORMAT_BGR24 &&
+                  (int)MDEC_PIXEL_RGBA32 == MDEC_PIXEL_FORMAT_RGBA32 &&
+                  (int)MDEC_PIXEL_BGRA32 == MDEC_PIXEL_FORMAT_BGRA32,
+              "C and C++ pixel formats must match");
+
+struct mdec_decoder
+{
+    MdecContext ctx;
+    MdecStats stats;
+    uint64_t frames = 0;
+    uint64_t macroblocks = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+};
+
+int mdec_api_version(void)
+{
+    return MDEC_API_VERSION;
+}
+
+int mdec_decoder_revision(void)
+{
+    return MDEC_DECODER_REVISION;
+}
+
+mdec_decoder *mdec_create(unsigned flags)
+{
+    mdec_decoder *decoder = new (std::nothrow) mdec_decoder;
+    if (!decoder)
+        return nullptr;
+    try
+    {
+        if (flags & MDEC_FLAG_MACROBLOCK_CACHE)
+            decoder->ctx.macroblock_cache = std::make_unique<MacroblockCache>();
+    }
+    catch (const std::bad_alloc &)
+    {
+        delete decoder;
+        return nullptr;
+    }
+    decoder->ctx.reuse_previous_frame = (flags & MDEC_FLAG_REUSE_PREVIOUS_FRAME) != 0;
+    if (flags & MDEC_FLAG_STATS)
+        decoder->ctx.stats = &decoder->stats;
+    return decoder;
+}
+
+void mdec_destroy(mdec_decoder *decoder)
+{
+    delete decoder;
+}
+
+int mdec_decode_frame(mdec_decoder *decoder, const uint16_t *words, size_t word_count, int width, int height,
+                      void *dst, size_t stride, mdec_pixel_format format)
+{
+    if (!decoder || (!words && word_count) || width <= 0 || height <= 0 || !dst || format < MDEC_PIXEL_RGB24 ||
+        format > MDEC_PIXEL_BGRA32)
+        return MDEC_ERROR_INVALID_ARGUMENT;
+
+    MdecPixelFormat pixel_format = (MdecPixelFormat)format;
+    size_t row_bytes = (size_t)width * mdec_pixel_size(pixel_format);
+    if (stride == 0)
+        stride = row_bytes;
+    if (stride < row_bytes)
+        return MDEC_ERROR_INVALID_ARGUMENT;
+
+    // The decoder only reads the words; the internal interface predates const
+    uint16_t *data = const_cast<uint16_t *>(words);
+    size_t macroblocks;
+    try
+    {
+        macroblocks = decode_mdec_frame(decoder->ctx, &data, data + word_count, width, height, (uint8_t *)dst,
+                                        stride, pixel_format);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return MDEC_ERROR_OUT_OF_MEMORY;
+    }
+
+    decoder->frames++;
+    decoder->macroblocks += macroblocks;
+    decoder->bytes_in += word_count * sizeof(uint16_t);
+    decoder->bytes_out += row_bytes * height;
+    return (int)macroblocks;
+}
+
+int mdec_set_quant_tables(mdec_decoder *decoder, const uint8_t luma[64], const uint8_t color[64])
+{
+    if (!decoder || !luma != !color)
+        return MDEC_ERROR_INVALID_ARGUMENT;
+    try
+    {
+        decoder->ctx.quant = luma ? mdec_quant_tables(luma, color) : mdec_default_quant_tables();
+    }
+    catch (const std::bad_alloc &)
+    {
+        return MDEC_ERROR_OUT_OF_MEMORY;
+    }
+    return MDEC_OK;
+}
+
+void mdec_get_stats(const mdec_decoder *decoder, mdec_stats *stats)
+{
+    if (!decoder || !stats)
+        return;
+
+    double rate = mdec_stats_tick_rate();
+    const MdecStats &s = decoder->stats;
+    const MacroblockCache *cache = decoder->ctx.macroblock_cache.get();
+    stats->frames = decoder->frames;
+    stats->macroblocks = decoder->macroblocks;
+    stats->bytes_in = decoder->bytes_in;
+    stats->bytes_out = decoder->bytes_out;
+    stats->blocks = s.blocks;
+    stats->dc_only_blocks = s.dc_only_blocks;
+    stats->nonzero_coefficients = s.nonzero_coefficients;
+    stats->padding_words = s.padding_words;
+    stats->reused_macroblocks = decoder->ctx.previous_frame_hits + (cache ? cache->hits : 0);
+    stats->rle_seconds = s.stage_ticks[MDEC_STAGE_RLE] / rate;
+    stats->idct_seconds = s.stage_ticks[MDEC_STAGE_IDCT] / rate;
+    stats->color_seconds = s.stage_ticks[MDEC_STAGE_COLOR] / rate;
+    stats->reassembly_seconds = s.stage_ticks[MDEC_STAGE_REASSEMBLY] / rate;
+}
+
+struct mdec_tiles
+{
+    mdec_tiles(const uint16_t *words, size_t word_count, int width, int height, int tile_macroblocks,
+               size_t cache_bytes)
+        : decoder(words, words + word_count, width, height, tile_macroblocks, cache_bytes), width(width),
+          height(height)
+    {
+    }
+
+    TiledDecoder decoder;
+    int width;
+    int height;
+};
+
+mdec_tiles *mdec_tiles_create(const uint16_t *words, size_t word_count, int width, int height, int tile_macroblocks,
+                              size_t cache_bytes)
+{
+    if ((!words && word_count) || width <= 0 || height <= 0 || tile_macroblocks < 0)
+        return nullptr;
+    try
+    {
+        return new mdec_tiles(words, word_count, width, height, tile_macroblocks > 0 ? tile_macroblocks : 4,
+                              cache_bytes > 0 ? cache_bytes : 16u << 20);
+    }
+    catch (const std::bad_alloc &)
+    {
+        return nullptr;
+    }
+}
+
+void mdec_tiles_destroy(mdec_tiles *tiles)
+{
+    delete tiles;
+}
+
+int mdec_tiles_read_region(mdec_tiles *tiles, int x, int y, int width, int height, void *dst, size_t stride)
+{
+    if (!tiles || !dst || width <= 0 || height <= 0)
+        return MDEC_ERROR_INVALID_ARGUMENT;
+    if (stride == 0)
+        stride = (size_t)std::min(width, tiles->width - x) * 3;
+    if (stride < (size_t)std::min(width, tiles->width - x) * 3)
+        return MDEC_ERROR_INVALID_ARGUMENT;
+
+    uint64_t before = tiles->decoder.macroblocks_decoded;
+    try
+    {
+        if (!tiles->decoder.read_region(x, y, width, height, (uint8_t *)dst, stride))
+            return MDEC_ERROR_INVALID_ARGUMENT;
+    }
+    catch (const std::bad_alloc &)
+    {
+        return MDEC_ERROR_OUT_OF_MEMORY;
+    }
+    return (int)(tiles->decoder.macroblocks_decoded - before);
+}
+
+const char *mdec_status_string(int status)
+{
+    if (status >= 0)
+        return "ok";
+    switch (status)
+    {
+    case MDEC_ERROR_INVALID_ARGUMENT:
+        return "invalid argument";
+    case MDEC_ERROR_OUT_OF_MEMORY:
+        return "out of memory";
+    default:
+        return "unknown error";
+    }
+}
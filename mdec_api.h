@@ -0,0 +1,105 @@
+#pragma once
+
+// C interface to libmdec. Only this header is needed to decode raw MDEC frames from C or any
+// language with a C FFI; the C++ headers beside it are internal and may change between versions.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bumped when a function or struct below changes incompatibly
+#define MDEC_API_VERSION 1
+
+typedef struct mdec_decoder mdec_decoder;
+
+typedef enum mdec_pixel_format
+{
+    MDEC_PIXEL_RGB24 = 0,
+    MDEC_PIXEL_BGR24 = 1,
+    MDEC_PIXEL_RGBA32 = 2, // alpha is always 0xff
+    MDEC_PIXEL_BGRA32 = 3
+} mdec_pixel_format;
+
+// Negative results of mdec_decode_frame
+typedef enum mdec_status
+{
+    MDEC_OK = 0,
+    MDEC_ERROR_INVALID_ARGUMENT = -1,
+    MDEC_ERROR_OUT_OF_MEMORY = -2
+} mdec_status;
+
+// Flags for mdec_create
+#define MDEC_FLAG_MACROBLOCK_CACHE 0x1 // reuse decoded macroblocks with identical compressed bytes
+#define MDEC_FLAG_STATS 0x2            // collect stage timings and block counters
+// Skip macroblocks identical to the same position in the previous frame. The words of the
+// previous frame must stay valid and unchanged until the next call returns.
+#define MDEC_FLAG_REUSE_PREVIOUS_FRAME 0x4
+
+// Totals since mdec_create. Timings and block counters need MDEC_FLAG_STATS and a library built
+// with MDEC_STATS; frames, macroblocks and bytes are always counted.
+typedef struct mdec_stats
+{
+    uint64_t frames;
+    uint64_t macroblocks;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t blocks;
+    uint64_t dc_only_blocks;
+    uint64_t nonzero_coefficients; // AC levels, excluding DC
+    uint64_t padding_words;        // 0xfe00 words skipped before a block header
+    uint64_t reused_macroblocks;   // cache and previous-frame hits
+    double rle_seconds;
+    double idct_seconds;
+    double color_seconds;
+    double reassembly_seconds;
+} mdec_stats;
+
+// Value of MDEC_API_VERSION the library was built with
+int mdec_api_version(void);
+
+// Changes whenever decoded pixels change, for keying caches of decoder output
+int mdec_decoder_revision(void);
+
+// A decoder keeps scratch memory between frames. Use one per thread; returns NULL on failure.
+mdec_decoder *mdec_create(unsigned flags);
+void mdec_destroy(mdec_decoder *decoder);
+
+// Decode word_count 16-bit RLE words (one frame, host byte order) into width x height pixels at
+// dst, rows stride bytes apart (0 = tightly packed). No memory is allocated once the decoder
+// has seen a frame of this size. Returns the number of macroblocks decoded, which is less than
+// ceil(width / 16) * ceil(height / 16) for truncated input, or a negative mdec_status.
+int mdec_decode_frame(mdec_decoder *decoder, const uint16_t *words, size_t word_count, int width, int height,
+                      void *dst, size_t stride, mdec_pixel_format format);
+
+// Dequantise with these tables, in zigzag order as the MDEC set-quant command uploads them,
+// instead of the standard ones (both NULL restores those). Takes effect from the next frame;
+// what is derived from a pair of tables is computed once per process and shared.
+int mdec_set_quant_tables(mdec_decoder *decoder, const uint8_t luma[64], const uint8_t color[64]);
+
+// Copy the decoder's totals to stats
+void mdec_get_stats(const mdec_decoder *decoder, mdec_stats *stats);
+
+// Random access to the pixels of one large image. Creation records where each macroblock
+// starts without decoding any; regions then decode only the tiles of tile_macroblocks x
+// tile_macroblocks macroblocks they overlap, keeping up to cache_bytes of decoded tiles
+// (0 = 4 macroblocks and 16 MB). words must stay valid until mdec_tiles_destroy. Returns NULL
+// on failure. Not thread-safe.
+typedef struct mdec_tiles mdec_tiles;
+mdec_tiles *mdec_tiles_create(const uint16_t *words, size_t word_count, int width, int height, int tile_macroblocks,
+                              size_t cache_bytes);
+void mdec_tiles_destroy(mdec_tiles *tiles);
+
+// Copy the RGB24 pixels of a rectangle, clipped to the image, to dst with rows stride bytes
+// apart (0 = packed). Returns the number of macroblocks decoded for it (0 if every tile was
+// cached), or a negative mdec_status.
+int mdec_tiles_read_region(mdec_tiles *tiles, int x, int y, int width, int height, void *dst, size_t stride);
+
+// Human-readable description of a status code
+const char *mdec_status_string(int status);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,286 @@
+#include "mdec_encoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "mdec.h"
+
+namespace
+{
+// Orthonormal 8-point DCT-II basis, dct_matrix[u][x] = C(u) / 2 * cos((2x + 1) u pi / 16).
+// Applied on both sides this gives JPEG-scaled coefficients, the domain rle_decode dequantises into.
+struct DctMatrix
+{
+    float m[8][8];
+
+    DctMatrix()
+    {
+        for (int u = 0; u < 8; u++)
+            for (int x = 0; x < 8; x++)
+                m[u][x] = (float)((u == 0 ? std::sqrt(0.5) : 1.0) / 2.0 * std::cos((2 * x + 1) * u * M_PI / 16.0));
+    }
+};
+
+const DctMatrix dct_matrix;
+
+// out = M * in, eight columns at a time so the inner loop maps onto SIMD lanes
+inline void fdct_pass(const float (*__restrict in)[8], float (*__restrict out)[8])
+{
+    for (int u = 0; u < 8; u++)
+    {
+        float acc[8] = {};
+        for (int y = 0; y < 8; y++)
+        {
+            float c = dct_matrix.m[u][y];
+            for (int x = 0; x < 8; x++)
+                acc[x] += c * in[y][x];
+        }
+        for (int x = 0; x < 8; x++)
+            out[u][x] = acc[x];
+    }
+}
+
+inline void transpose(const float (*__restrict in)[8], float (*__restrict out)[8])
+{
+    for (int y = 0; y < 8; y++)
+        for (int x = 0; x < 8; x++)
+            out[x][y] = in[y][x];
+}
+
+// Forward DCT of one block into zigzag order, prepared for quantisation (see MdecCoefficients)
+void forward_block(const float (*block)[8], const uint8_t *quant, float *dst)
+{
+    float rows[8][8], cols[8][8], freq[8][8];
+    fdct_pass(block, rows);   // rows[v][x]: vertical frequencies
+    transpose(rows, cols);    // cols[x][v]
+    fdct_pass(cols, freq);    // freq[u][v]: horizontal frequency u, vertical v
+
+    for (int i = 0; i < 64; i++)
+    {
+        int k = zigzag[i];
+        float f = freq[i % 8][i / 8];
+        int q = quant[k];
+        if (k == 0)
+            dst[k] = f / (q ? q : 2);
+        else
+            dst[k] = q ? f * 8.0f / q : 0.0f;
+    }
+}
+
+// Level shifted YCbCr of one 16x16 macroblock, then its six blocks in stream order
+void forward_macroblock(const uint8_t *rgb, int width, int height, int mb_x, int mb_y, float *dst)
+{
+    float y_plane[16][16];
+    float cb_sum[8][8] = {};
+    float cr_sum[8][8] = {};
+
+    for (int y = 0; y < 16; y++)
+    {
+        int sy = std::min(mb_y + y, height - 1);
+        for (int x = 0; x < 16; x++)
+        {
+            int sx = std::min(mb_x + x, width - 1);
+            const uint8_t *p = rgb + ((size_t)sy * width + sx) * 3;
+            float r = p[0], g = p[1], b = p[2];
+            y_plane[y][x] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+            cb_sum[y / 2][x / 2] += -0.168736f * r - 0.331264f * g + 0.5f * b;
+            cr_sum[y / 2][x / 2] += 0.5f * r - 0.418688f * g - 0.081312f * b;
+        }
+    }
+
+    float block[8][8];
+    for (int y = 0; y < 8; y++)
+        for (int x = 0; x < 8; x++)
+            block[y][x] = cr_sum[y][x] * 0.25f;
+    forward_block(block, c_quant_table, dst);
+    for (int y = 0; y < 8; y++)
+        for (int x = 0; x < 8; x++)
+            block[y][x] = cb_sum[y][x] * 0.25f;
+    forward_block(block, c_quant_table, dst + 64);
+
+    // Y0 (0,0), Y1 (8,0), Y2 (0,8), Y3 (8,8), matching process_macroblock
+    for (int b = 0; b < 4; b++)
+    {
+        int ox = (b & 1) * 8, oy = (b >> 1) * 8;
+        for (int y = 0; y < 8; y++)
+            for (int x = 0; x < 8; x++)
+                block[y][x] = y_plane[oy + y][ox + x];
+        forward_block(block, y_quant_table, dst + 64 * (2 + b));
+    }
+}
+
+inline int quantize_level(float value)
+{
+    return std::clamp((int)std::lround(value), -512, 511);
+}
+
+void emit_block(const float *coef, int q_scale, std::vector<uint16_t> &words)
+{
+    // At q_scale 63 a DC of -512 would make the header 0xfe00, which decoders skip as padding
+    int dc = std::max(quantize_level(coef[0]), q_scale == 63 ? -511 : -512);
+    words.push_back((uint16_t)(q_scale << 10 | (dc & 0x3ff)));
+
+    float inv_scale = 1.0f / q_scale;
+    int run = 0;
+    for (int k = 1; k < 64; k++)
+    {
+        int level = quantize_level(coef[k] * inv_scale);
+        if (level == 0)
+        {
+            run++;
+            continue;
+        }
+        words.push_back((uint16_t)(run << 10 | (level & 0x3ff)));
+        run = 0;
+    }
+    // Always, even after coefficient 63: the hardware reads one more word there
+    words.push_back(0xfe00);
+}
+
+// Largest q_scale at which emit_block still codes value as a nonzero level (0 if none)
+int max_nonzero_q_scale(float value)
+{
+    // lround(|v| / q) >= 1 exactly when q <= 2|v|; the loops settle float rounding at the edge
+    int q = (int)std::min(63.0f, 2.0f * std::fabs(value));
+    while (q > 0 && quantize_level(value * (1.0f / q)) == 0)
+        q--;
+    while (q < 63 && quantize_level(value * (1.0f / (q + 1))) != 0)
+        q++;
+    return q;
+}
+
+int resolve_threads(int threads, size_t work)
+{
+    int count = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+    return (int)std::max<size_t>(1, std::min<size_t>(count, work));
+}
+
+// Run fn(begin, end, index) over contiguous slices of [0, count)
+template <typename Fn>
+void parallel_slices(size_t count, int threads, Fn fn)
+{
+    if (threads <= 1)
+    {
+        fn(size_t(0), count, 0);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back(fn, count * t / threads, count * (t + 1) / threads, t);
+    for (std::thread &w : workers)
+        w.join();
+}
+} // namespace
+
+void forward_transform_image(const uint8_t *rgb, int width, int height, int threads,
+                             MdecCoefficients &coefficients)
+{
+    int columns = (width + 15) / 16;
+    int rows = (height + 15) / 16;
+    coefficients.width = width;
+    coefficients.height = height;
+    coefficients.macroblocks = (size_t)columns * rows;
+    coefficients.values.resize(coefficients.macroblocks * 6 * 64);
+
+    parallel_slices(coefficients.macroblocks, resolve_threads(threads, coefficients.macroblocks),
+                    [&](size_t begin, size_t end, int)
+                    {
+                        for (size_t mb = begin; mb < end; mb++)
+                            forward_macroblock(rgb, width, height, (int)(mb / rows) * 16, (int)(mb % rows) * 16,
+                                               &coefficients.values[mb * 6 * 64]);
+                    });
+}
+
+void emit_mdec_words(const MdecCoefficients &coefficients, int q_scale, int threads,
+                     std::vector<uint16_t> &words)
+{
+    int count = resolve_threads(threads, coefficients.macroblocks);
+    std::vector<std::vector<uint16_t>> slices(count);
+    parallel_slices(coefficients.macroblocks, count,
+                    [&](size_t begin, size_t end, int t)
+                    {
+                        std::vector<uint16_t> &out = slices[t];
+                        out.reserve((end - begin) * 6 * 8);
+                        for (size_t block = begin * 6; block < end * 6; block++)
+                            emit_block(&coefficients.values[block * 64], q_scale, out);
+                    });
+
+    for (const std::vector<uint16_t> &slice : slices)
+        words.insert(words.end(), slice.begin(), slice.end());
+}
+
+std::array<size_t, 64> predict_mdec_words(const MdecCoefficients &coefficients)
+{
+    // ac[q]: AC values last nonzero at q
+    size_t ac[64] = {};
+    size_t blocks = coefficients.macroblocks * 6;
+    for (size_t block = 0; block < blocks; block++)
+    {
+        const float *coef = &coefficients.values[block * 64];
+        for (int k = 1; k < 64; k++)
+        {
+            float value = coef[k];
+            if (std::fabs(value) >= 0.5f)
+                ac[max_nonzero_q_scale(value)]++;
+        }
+    }
+
+    // Header and end of block per block, plus every AC value still nonzero at q_scale
+    std::array<size_t, 64> sizes{};
+    size_t nonzero = 0;
+    for (int q = 63; q >= 1; q--)
+    {
+        nonzero += ac[q];
+        sizes[q] = blocks * 2 + nonzero;
+    }
+    return sizes;
+}
+
+int choose_q_scale(const std::array<size_t, 64> &sizes, size_t budget)
+{
+    for (int q = 1; q < 64; q++)
+        if (sizes[q] <= budget)
+            return q;
+    return 0;
+}
+
+MdecEncodeResult encode_mdec_image(const uint8_t *rgb, int width, int height, const MdecEncodeOptions &options,
+                                   std::vector<uint16_t> &words)
+{
+    MdecCoefficients coefficients;
+    forward_transform_image(rgb, width, height, options.threads, coefficients);
+
+    MdecEncodeResult result;
+    result.macroblocks = coefficients.macroblocks;
+    result.q_scale = std::clamp(options.q_scale, 1, 63);
+    if (options.word_budget)
+    {
+        result.q_scale = choose_q_scale(predict_mdec_words(coefficients), options.word_budget);
+        result.fits = result.q_scale != 0;
+        if (!result.fits)
+            result.q_scale = 63;
+    }
+
+    size_t before = words.size();
+    emit_mdec_words(coefficients, result.q_scale, options.threads, words);
+    result.words = words.size() - before;
+    if (options.word_budget)
+        result.fits = result.words <= options.word_budget;
+    return result;
+}
+
+bool write_mdec_file(const char *path, const std::vector<uint16_t> &words)
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+    {
+        std::cerr << "Error: Could not open output file " << path << std::endl;
+        return false;
+    }
+    out.write(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(uint16_t));
+    return (bool)out;
+}
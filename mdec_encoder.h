@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct MdecEncodeOptions
+{
+    int q_scale = 8;        // 1-63, applied to every block
+    int threads = 0;        // 0 = all hardware threads
+    size_t word_budget = 0; // when set, q_scale is the smallest that fits the budget instead
+};
+
+struct MdecEncodeResult
+{
+    size_t macroblocks = 0;
+    size_t words = 0;
+    int q_scale = 0;
+    bool fits = true; // false if the words exceed word_budget, i.e. even q_scale 63 does
+};
+
+// Forward-transformed image: six blocks per macroblock in stream order (Cr, Cb, Y0-Y3, with
+// macroblocks column-major like decode_mdec_frame), 64 zigzag-ordered values per block.
+// Values are already divided by the quantisation table entry (AC also multiplied by 8), so
+// the level emitted at a q_scale is round(value / q_scale) for AC and round(value) for DC.
+struct MdecCoefficients
+{
+    int width = 0;
+    int height = 0;
+    size_t macroblocks = 0;
+    std::vector<float> values;
+};
+
+// RGB24 (width * 3 bytes per row) to YCbCr 4:2:0, level shift and forward DCT. Edge
+// macroblocks are padded by repeating the last column/row.
+void forward_transform_image(const uint8_t *rgb, int width, int height, int threads,
+                             MdecCoefficients &coefficients);
+
+// Quantise at q_scale and append the run/level words: a (q_scale << 10 | DC) header, one
+// (run << 10 | level) word per nonzero AC coefficient and a 0xfe00 end of block.
+void emit_mdec_words(const MdecCoefficients &coefficients, int q_scale, int threads,
+                     std::vector<uint16_t> &words);
+
+// Exact number of words emit_mdec_words would produce at every q_scale (index 1-63) from one
+// pass over the coefficients. Each AC value stays nonzero up to some q_scale, so a histogram of
+// those maxima gives the AC word count per scale.
+std::array<size_t, 64> predict_mdec_words(const MdecCoefficients &coefficients);
+
+// Smallest q_scale (best quality) whose predicted size fits budget words, or 0 if none does
+int choose_q_scale(const std::array<size_t, 64> &sizes, size_t budget);
+
+// Encode an RGB24 image to MDEC RLE words, appending to words
+MdecEncodeResult encode_mdec_image(const uint8_t *rgb, int width, int height, const MdecEncodeOptions &options,
+                                   std::vector<uint16_t> &words);
+
+// Write words as a raw little-endian .bin, the layout read_mdec_file expects
+bool write_mdec_file(const char *path, const std::vector<uint16_t> &words);
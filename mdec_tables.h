@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Decoder tables generated at compile time from their definitions instead of typed in. Each
+// kernel gets the layout it indexes (zigzag or natural order, transposed) and the number form
+// it multiplies with (double or fixed point), so a new variant only needs a new generator here.
+// std::cos and std::sqrt are not constexpr in C++20, hence the series below; mdec_verify checks
+// the results against the runtime functions.
+
+constexpr double table_pi = 3.14159265358979323846;
+
+constexpr double table_floor(double x)
+{
+    double i = (double)(int64_t)x;
+    return i > x ? i - 1 : i;
+}
+
+constexpr double table_round(double x)
+{
+    return table_floor(x + 0.5);
+}
+
+constexpr double table_cos(double x)
+{
+    while (x > table_pi)
+        x -= 2 * table_pi;
+    while (x < -table_pi)
+        x += 2 * table_pi;
+    double term = 1, sum = 1;
+    for (int n = 1; n < 30; n++)
+    {
+        term *= -x * x / ((2 * n - 1) * (2 * n));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double table_sqrt(double x)
+{
+    double r = x > 1 ? x : 1;
+    for (int i = 0; i < 100; i++)
+        r = 0.5 * (r + x / r);
+    return r;
+}
+
+// Round x to a number of decimal places, or of significant digits (x > 0), as the values were
+// originally printed
+constexpr double table_round_decimals(double x, int decimals)
+{
+    double scale = 1;
+    for (int i = 0; i < decimals; i++)
+        scale *= 10;
+    return table_round(x * scale) / scale;
+}
+
+constexpr double table_round_significant(double x, int digits)
+{
+    int decimals = digits;
+    for (; x >= 1; x /= 10)
+        decimals--;
+    for (double y = x; y < 0.1; y *= 10)
+        decimals++;
+    double scale = 1;
+    for (int i = 0; i < -decimals; i++)
+        scale *= 10;
+    return decimals >= 0 ? table_round_decimals(x, decimals) : table_round(x / scale) * scale;
+}
+
+// Natural (row-major) index of each zigzag position: diagonals alternate between running up
+// to the right (even) and down to the left (odd)
+constexpr std::array<uint8_t, 64> make_zagzig()
+{
+    std::array<uint8_t, 64> table{};
+    int k = 0;
+    for (int diagonal = 0; diagonal < 15; diagonal++)
+    {
+        for (int i = 0; i <= diagonal; i++)
+        {
+            int row = diagonal % 2 ? i : diagonal - i;
+            int col = diagonal - row;
+            if (row < 8 && col < 8)
+                table[k++] = (uint8_t)(row * 8 + col);
+        }
+    }
+    return table;
+}
+
+// Zigzag position of each natural index (inverse of zagzig)
+constexpr std::array<uint8_t, 64> make_zigzag()
+{
+    std::array<uint8_t, 64> zagzig = make_zagzig();
+    std::array<uint8_t, 64> table{};
+    for (int k = 0; k < 64; k++)
+        table[zagzig[k]] = (uint8_t)k;
+    return table;
+}
+
+// AAN scale factors: 1 for the DC term, sqrt(2) * cos(i * pi / 16) otherwise, to 9 decimals
+constexpr std::array<double, 8> make_scalefactor()
+{
+    std::array<double, 8> table{};
+    for (int i = 0; i < 8; i++)
+        table[i] = i == 0 ? 1.0 : table_round_decimals(table_sqrt(2) * table_cos(i * table_pi / 16), 9);
+    return table;
+}
+
+// idct_core prescale in zigzag order: scalefactor[row] * scalefactor[column] / 8 of the
+// coefficient's natural position, to 6 significant digits
+constexpr std::array<double, 64> make_scalezag()
+{
+    std::array<uint8_t, 64> zagzig = make_zagzig();
+    std::array<double, 8> scalefactor = make_scalefactor();
+    std::array<double, 64> table{};
+    for (int k = 0; k < 64; k++)
+        table[k] = table_round_significant(scalefactor[zagzig[k] / 8] * scalefactor[zagzig[k] % 8] / 8, 6);
+    return table;
+}
+
+// The same prescale in natural order, for kernels that take de-zigzagged coefficients
+constexpr std::array<double, 64> make_scalezag_natural()
+{
+    std::array<uint8_t, 64> zigzag = make_zigzag();
+    std::array<double, 64> scalezag = make_scalezag();
+    std::array<double, 64> table{};
+    for (int i = 0; i < 64; i++)
+        table[i] = scalezag[zigzag[i]];
+    return table;
+}
+
+// The natural order prescale in fixed point with SCALEZAG_FIXED_BITS fraction bits
+#define SCALEZAG_FIXED_BITS 32
+constexpr std::array<uint32_t, 64> make_scalezag_natural_fixed()
+{
+    std::array<double, 64> scalezag = make_scalezag_natural();
+    std::array<uint32_t, 64> table{};
+    for (int i = 0; i < 64; i++)
+        table[i] = (uint32_t)table_round(scalezag[i] * (double)(1ull << SCALEZAG_FIXED_BITS));
+    return table;
+}
+
+// DCT basis in Q15 as the PSX MDEC holds it: scale_table[u * 8 + x] is
+// floor(32768 * c(u) * cos((2x + 1) * u * pi / 16)) with c(0) = 1 / sqrt(2), c(u) = 1
+constexpr std::array<int16_t, 64> make_scale_table()
+{
+    std::array<int16_t, 64> table{};
+    for (int u = 0; u < 8; u++)
+    {
+        double c = u == 0 ? 1 / table_sqrt(2) : 1.0;
+        for (int x = 0; x < 8; x++)
+            table[u * 8 + x] = (int16_t)table_floor(32768 * c * table_cos((2 * x + 1) * u * table_pi / 16));
+    }
+    return table;
+}
+
+// scale_table transposed (x * 8 + u) and divided by 8 as idct_scale_table applies it, so the
+// matrix IDCT's inner loop reads consecutive entries
+constexpr std::array<int16_t, 64> make_scale_table_transposed()
+{
+    std::array<int16_t, 64> scale_table = make_scale_table();
+    std::array<int16_t, 64> table{};
+    for (int u = 0; u < 8; u++)
+        for (int x = 0; x < 8; x++)
+            table[x * 8 + u] = (int16_t)(scale_table[u * 8 + x] / 8);
+    return table;
+}
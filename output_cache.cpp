@@ -0,0 +1,168 @@
+#include "output_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "hash.h"
+#include "mdec.h"
+
+namespace fs = std::filesystem;
+
+// Entries are named <key>.<ext>; skip the .tmp files store is still writing, in this process
+// or another one
+static bool is_cache_entry(const fs::directory_entry &entry, std::error_code &ec)
+{
+    return entry.is_regular_file(ec) && entry.path().filename().string().find(".tmp") == std::string::npos;
+}
+
+OutputCache::OutputCache(const std::string &dir, uint64_t max_bytes)
+    : dir_(dir), max_bytes_(max_bytes)
+{
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+
+    uint64_t total = 0;
+    for (const fs::directory_entry &entry : fs::recursive_directory_iterator(dir_, ec))
+        if (is_cache_entry(entry, ec))
+            total += entry.file_size(ec);
+    total_bytes_ = total;
+}
+
+uint64_t OutputCache::key(const uint16_t *words, size_t count, int width, int height, const std::string &output,
+                          const PngOptions &png_options, const MdecQuantTables *quant) const
+{
+    // Everything besides the input words that affects the output bytes
+    std::ostringstream params;
+    params << width << 'x' << height << ' ' << fs::path(output).extension().string()
+           << " idct=" << MDEC_DECODER_REVISION;
+    // Only non-standard tables are named, so entries written before they existed stay valid
+    if (quant != mdec_default_quant_tables())
+        params << " quant=" << std::hex << quant->hash << std::dec;
+    if (image_format_from_path(output.c_str()) == IMAGE_FORMAT_PNG)
+        params << " png=" << png_options.compression_level << ',' << png_options.filter << ','
+               << png_options.threads;
+    std::string p = params.str();
+
+    uint64_t h = mdec_hash64(words, count * sizeof(uint16_t));
+    return mdec_hash64(p.data(), p.size(), h);
+}
+
+std::string OutputCache::entry_path(uint64_t key, const std::string &output) const
+{
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+    fs::path path = fs::path(dir_) / std::string(name, 2) / name;
+    path += fs::path(output).extension();
+    return path.string();
+}
+
+bool OutputCache::fetch(uint64_t key, const std::string &output)
+{
+    std::error_code ec;
+    std::string entry = entry_path(key, output);
+    if (!fs::is_regular_file(entry, ec))
+    {
+        misses++;
+        return false;
+    }
+
+    // Copy rather than link: a hard link would let any later in-place write to output (every
+    // writer truncates and rewrites) change the entry too. The copy is renamed over output so
+    // whatever was there, including a link left by an older version, is replaced, not written
+    // through.
+    std::ostringstream tmp_name;
+    tmp_name << output << ".tmp" << std::this_thread::get_id();
+    fs::path tmp = tmp_name.str();
+    if (fs::copy_file(entry, tmp, fs::copy_options::overwrite_existing, ec))
+        fs::rename(tmp, output, ec);
+    if (ec)
+    {
+        fs::remove(tmp, ec);
+        misses++;
+        return false;
+    }
+
+    // Entry modification time doubles as its last-use time for eviction
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);
+    hits++;
+    return true;
+}
+
+void OutputCache::store(uint64_t key, const std::string &output)
+{
+    std::error_code ec;
+    fs::path entry = entry_path(key, output);
+    if (fs::exists(entry, ec))
+        return; // another worker stored the same content first
+    fs::create_directories(entry.parent_path(), ec);
+
+    // Copy (rather than link) so later in-place rewrites of output cannot change the entry,
+    // and publish with a rename so concurrent workers never see a partial file
+    std::ostringstream tmp_name;
+    tmp_name << entry.string() << ".tmp" << std::this_thread::get_id();
+    fs::path tmp = tmp_name.str();
+    if (!fs::copy_file(output, tmp, fs::copy_options::overwrite_existing, ec))
+        return;
+    uint64_t size = fs::file_size(tmp, ec);
+    fs::rename(tmp, entry, ec);
+    if (ec)
+    {
+        fs::remove(tmp, ec);
+        return;
+    }
+
+    if ((total_bytes_ += size) > max_bytes_)
+        evict();
+}
+
+void OutputCache::evict()
+{
+    std::lock_guard<std::mutex> lock(evict_mutex_);
+
+    struct Entry
+    {
+        fs::path path;
+        fs::file_time_type used;
+        uint64_t size;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+
+    std::error_code ec;
+    for (const fs::directory_entry &entry : fs::recursive_directory_iterator(dir_, ec))
+    {
+        if (!is_cache_entry(entry, ec))
+            continue;
+        Entry e{entry.path(), entry.last_write_time(ec), entry.file_size(ec)};
+        total += e.size;
+        entries.push_back(e);
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+              { return a.used < b.used; });
+    for (const Entry &e : entries)
+    {
+        if (total <= max_bytes_)
+            break;
+        if (fs::remove(e.path, ec))
+        {
+            total -= e.size;
+            evictions++;
+        }
+    }
+    total_bytes_ = total;
+}
+
+void OutputCache::print_stats() const
+{
+    uint64_t lookups = hits + misses;
+    printf("Cache: %llu hits, %llu misses (%.1f%% hit rate), %llu evicted, %.2f/%.2f MB used\n",
+           (unsigned long long)hits.load(), (unsigned long long)misses.load(),
+           lookups ? 100.0 * hits / lookups : 0.0, (unsigned long long)evictions.load(),
+           total_bytes_ / (1024.0 * 1024.0), max_bytes_ / (1024.0 * 1024.0));
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "image_writer.h"
+#include "quant_tables.h"
+
+// On-disk, content-addressed cache of encoded outputs. Entries are keyed by a hash of the
+// input RLE words plus every parameter that changes the output bytes, so an unchanged input
+// (or the same image duplicated elsewhere) is served by copying the cached file instead of
+// decoding and re-encoding it. The least recently used entries are evicted once the cache grows
+// past max_bytes.
+class OutputCache
+{
+public:
+    OutputCache(const std::string &dir, uint64_t max_bytes);
+
+    uint64_t key(const uint16_t *words, size_t count, int width, int height, const std::string &output,
+                 const PngOptions &png_options, const MdecQuantTables *quant) const;
+
+    // Place the cached file for key at output. Returns false on a miss.
+    bool fetch(uint64_t key, const std::string &output);
+
+    // Add a freshly written output under key, evicting old entries if over budget
+    void store(uint64_t key, const std::string &output);
+
+    // Remove least recently used entries until the cache fits in max_bytes
+    void evict();
+
+    void print_stats() const;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+
+private:
+    std::string entry_path(uint64_t key, const std::string &output) const;
+
+    std::string dir_;
+    uint64_t max_bytes_;
+    std::atomic<uint64_t> total_bytes_{0};
+    std::mutex evict_mutex_;
+};
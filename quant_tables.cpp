@@ -0,0 +1,103 @@
+#include "quant_tables.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "hash.h"
+#include "mdec.h"
+
+// Every pair seen so far. Games use a handful, so a linear search on the hash is enough.
+static std::mutex registry_mutex;
+static std::vector<std::unique_ptr<MdecQuantTables>> registry;
+
+const MdecQuantTables *mdec_quant_tables(const uint8_t y[64], const uint8_t c[64])
+{
+    uint8_t both[128];
+    memcpy(both, y, 64);
+    memcpy(both + 64, c, 64);
+    uint64_t hash = mdec_hash64(both, sizeof(both));
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (const auto &tables : registry)
+        if (tables->hash == hash && memcmp(tables->y, y, 64) == 0 && memcmp(tables->c, c, 64) == 0)
+            return tables.get();
+
+    auto tables = std::make_unique<MdecQuantTables>();
+    memcpy(tables->y, y, 64);
+    memcpy(tables->c, c, 64);
+    tables->hash = hash;
+    for (int q_scale = 0; q_scale < 64; q_scale++)
+    {
+        for (int k = 0; k < 64; k++)
+        {
+            tables->ac_factors[0][q_scale][k] = (uint16_t)(y[k] * q_scale);
+            tables->ac_factors[1][q_scale][k] = (uint16_t)(c[k] * q_scale);
+        }
+    }
+    registry.push_back(std::move(tables));
+    return registry.back().get();
+}
+
+const MdecQuantTables *mdec_default_quant_tables()
+{
+    static const MdecQuantTables *tables = mdec_quant_tables(y_quant_table, c_quant_table);
+    return tables;
+}
+
+size_t parse_mdec_set_quant(const uint32_t *words, size_t count, const MdecQuantTables *current,
+                            const MdecQuantTables **tables)
+{
+    if (count == 0 || !is_mdec_set_quant(words[0]))
+        return 0;
+    bool color = (words[0] & MDEC_SET_QUANT_COLOR) != 0;
+    size_t payload = color ? 32 : 16;
+    if (count < 1 + payload)
+        return 0;
+
+    uint8_t y[64], c[64];
+    memcpy(y, words + 1, 64);
+    if (color)
+        memcpy(c, words + 17, 64);
+    else
+        memcpy(c, current->c, 64);
+    *tables = mdec_quant_tables(y, c);
+    return 1 + payload;
+}
+
+bool load_mdec_quant_tables(const char *path, const MdecQuantTables **tables, std::string &error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        error = std::string("Could not open ") + path;
+        return false;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    uint32_t command = 0;
+    if (bytes.size() >= 4)
+        memcpy(&command, bytes.data(), 4);
+    if ((bytes.size() == 68 || bytes.size() == 132) && is_mdec_set_quant(command))
+    {
+        std::vector<uint32_t> words(bytes.size() / 4);
+        memcpy(words.data(), bytes.data(), bytes.size());
+        if (parse_mdec_set_quant(words.data(), words.size(), mdec_default_quant_tables(), tables) == words.size())
+            return true;
+    }
+    else if (bytes.size() == 64)
+    {
+        *tables = mdec_quant_tables(bytes.data(), bytes.data());
+        return true;
+    }
+    else if (bytes.size() == 128)
+    {
+        *tables = mdec_quant_tables(bytes.data(), bytes.data() + 64);
+        return true;
+    }
+    error = std::string(path) + " is not 64 or 128 bytes of quantisation tables or a set-quant command";
+    return false;
+}
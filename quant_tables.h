@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// One pair of MDEC quantisation tables, in zigzag order as the set-quant command uploads them,
+// with what the decoder derives from them. Instances are shared and immutable: get them from
+// mdec_quant_tables, which derives each distinct pair once, so a context switching between
+// tables (e.g. per frame of a command stream) only swaps a pointer.
+struct MdecQuantTables
+{
+    uint8_t y[64];
+    uint8_t c[64];
+    uint64_t hash; // of y and c; seeds macroblock cache keys
+
+    // quant[k] * q_scale for each table (Y, then Cr/Cb), q_scale and zigzag position k: the
+    // factor the AC dequantiser multiplies a level by (0 selects its level * 2 case)
+    uint16_t ac_factors[2][64][64];
+
+    const uint8_t *table(bool luma) const { return luma ? y : c; }
+    const uint16_t *factors(bool luma, uint8_t q_scale) const { return ac_factors[luma ? 0 : 1][q_scale & 0x3f]; }
+};
+
+// The standard tables (y_quant_table, c_quant_table), used by contexts unless set otherwise
+const MdecQuantTables *mdec_default_quant_tables();
+
+// The shared instance for these tables, derived on first use. Instances live until the process
+// exits; thread-safe.
+const MdecQuantTables *mdec_quant_tables(const uint8_t y[64], const uint8_t c[64]);
+
+// Bit 0 of a set-quant command word: a colour table follows the luminance table
+#define MDEC_SET_QUANT_COLOR 0x1
+
+// Whether a 32-bit MDEC command word is set-quant (command 2, 0x4000000x)
+inline bool is_mdec_set_quant(uint32_t command)
+{
+    return (command >> 29) == 2;
+}
+
+// Apply a set-quant command: the command word and its payload of 16 words (luminance only,
+// the colour table is kept from current) or 32 words (luminance, then colour), in the byte
+// order the MDEC receives them. Returns the words consumed, or 0 if the payload is cut off.
+size_t parse_mdec_set_quant(const uint32_t *words, size_t count, const MdecQuantTables *current,
+                            const MdecQuantTables **tables);
+
+// Load tables from a file of 64 bytes (one table for both), 128 bytes (luminance, then colour)
+// or a set-quant command with its payload, e.g. captured from an emulator
+bool load_mdec_quant_tables(const char *path, const MdecQuantTables **tables, std::string &error);
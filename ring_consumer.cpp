@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_ring.h"
+#include "hash.h"
+#include "image_writer.h"
+
+static void print_usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " <ring name> [options]" << std::endl
+              << "Reads frames published by `mdec_decoder --frames ... --ring NAME` in place." << std::endl
+              << "  --dump PATTERN   write every Nth frame to PATTERN, e.g. frame_%04d.png" << std::endl
+              << "  --every N        frames between dumps (default 1)" << std::endl
+              << "  --delay MS       hold each frame MS milliseconds, to simulate a slow consumer" << std::endl
+              << "  --wait S         seconds to wait for the producer to create the ring (default 10)" << std::endl;
+}
+
+// Packed RGB copy of a slot in any of the ring's pixel formats
+static void slot_to_rgb(const uint8_t *pixels, const FrameRingHeader &header, std::vector<uint8_t> &rgb)
+{
+    int pixel_size = mdec_pixel_size((MdecPixelFormat)header.pixel_format);
+    bool bgr = header.pixel_format == MDEC_PIXEL_FORMAT_BGR24 || header.pixel_format == MDEC_PIXEL_FORMAT_BGRA32;
+    rgb.resize((size_t)header.width * header.height * 3);
+    uint8_t *out = rgb.data();
+    for (uint32_t y = 0; y < header.height; y++)
+    {
+        const uint8_t *row = pixels + y * header.stride;
+        for (uint32_t x = 0; x < header.width; x++, out += 3)
+        {
+            const uint8_t *p = row + x * pixel_size;
+            out[0] = p[bgr ? 2 : 0];
+            out[1] = p[1];
+            out[2] = p[bgr ? 0 : 2];
+        }
+    }
+}
+
+// Example consumer of a shared-memory frame ring
+int main(int argc, char *argv[])
+{
+    const char *name = nullptr;
+    const char *dump = nullptr;
+    uint64_t every = 1;
+    int delay_ms = 0;
+    double wait_seconds = 10;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--dump" && i + 1 < argc)
+            dump = argv[++i];
+        else if (arg == "--every" && i + 1 < argc)
+            every = std::max<uint64_t>(1, std::stoull(argv[++i]));
+        else if (arg == "--delay" && i + 1 < argc)
+            delay_ms = std::stoi(argv[++i]);
+        else if (arg == "--wait" && i + 1 < argc)
+            wait_seconds = std::stod(argv[++i]);
+        else if (!name)
+            name = argv[i];
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!name)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // The producer may not have created the ring yet
+    FrameRing ring;
+    std::string error;
+    auto give_up = std::chrono::steady_clock::now() + std::chrono::duration<double>(wait_seconds);
+    while (!ring.open(name, error))
+    {
+        if (std::chrono::steady_clock::now() >= give_up)
+        {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    const FrameRingHeader &header = ring.header();
+    printf("Ring %s: %ux%u, %u slots of %llu bytes\n", name, header.width, header.height, header.slot_count,
+           (unsigned long long)header.slot_bytes);
+
+    uint64_t frames = 0;
+    uint64_t combined = 0;
+    double latency_total = 0;
+    double latency_max = 0;
+    std::vector<uint8_t> rgb;
+    auto start = std::chrono::steady_clock::now();
+    FrameRingFrame frame;
+    while (ring.acquire_read(frame) == FRAME_RING_OK)
+    {
+        // Both processes read the same monotonic clock
+        double latency = (std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now().time_since_epoch())
+                              .count() -
+                          (double)frame.timestamp_ns) /
+                         1000.0;
+        latency_total += latency;
+        latency_max = std::max(latency_max, latency);
+
+        combined = combined * 31 + mdec_hash64(frame.pixels, header.stride * header.height);
+        if (dump && frame.index % every == 0)
+        {
+            char path[4096];
+            snprintf(path, sizeof(path), dump, (int)frame.index);
+            slot_to_rgb(frame.pixels, header, rgb);
+            if (!write_image(path, header.width, header.height, rgb.data(), PngOptions()))
+                std::cerr << "Error: Could not write " << path << std::endl;
+        }
+        if (delay_ms > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        ring.release_read();
+        frames++;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Read %llu frames in %.3f s (%.1f fps), publish-to-read latency mean %.0f us, max %.0f us\n",
+           (unsigned long long)frames, seconds, seconds > 0 ? frames / seconds : 0.0,
+           frames ? latency_total / frames : 0.0, latency_max);
+    printf("Frame hash %016llx\n", (unsigned long long)combined);
+    return 0;
+}
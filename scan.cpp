@@ -0,0 +1,140 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "disc_scanner.h"
+#include "image_writer.h"
+#include "trace.h"
+
+namespace fs = std::filesystem;
+
+static void print_usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " <disc.bin|disc.iso|file> [options]" << std::endl
+              << "  --out-dir DIR    extract every hit into DIR (default: list only)" << std::endl
+              << "  --threads N      scan and extraction threads (default: all hardware threads)" << std::endl
+              << "  --min-mbs N      ignore MDEC streams shorter than N macroblocks (default 16)" << std::endl
+              << "  --no-str         skip STR video frames" << std::endl
+              << "  --trace F        write per-thread scan spans to F (Chrome trace JSON)" << std::endl;
+}
+
+static std::string asset_file_name(const DiscAsset &asset)
+{
+    char name[96];
+    if (asset.type == DISC_ASSET_MDEC)
+        snprintf(name, sizeof(name), "mdec_%010llx_%zumb.bin", (unsigned long long)asset.file_offset,
+                 asset.macroblocks);
+    else
+        snprintf(name, sizeof(name), "str_%010llx_frame%u_%dx%d.bs", (unsigned long long)asset.file_offset,
+                 asset.frame, asset.width, asset.height);
+    return name;
+}
+
+// Locate MDEC streams and STR frames in a disc image and optionally extract them
+int main(int argc, char *argv[])
+{
+    std::vector<const char *> args;
+    DiscScanOptions options;
+    const char *out_dir = nullptr;
+    const char *trace_path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--out-dir" && i + 1 < argc)
+            out_dir = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc)
+            options.threads = std::stoi(argv[++i]);
+        else if (arg == "--min-mbs" && i + 1 < argc)
+            options.min_macroblocks = std::stoul(argv[++i]);
+        else if (arg == "--no-str")
+            options.str = false;
+        else if (arg == "--trace" && i + 1 < argc)
+            trace_path = argv[++i];
+        else
+            args.push_back(argv[i]);
+    }
+
+    if (args.size() != 1)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (trace_path)
+        trace_enable(true);
+
+    DiscImage image;
+    std::string error;
+    if (!image.open(args[0], error))
+    {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<DiscAsset> assets = scan_disc_image(image, options);
+    double scan_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t mdec_count = 0;
+    for (const DiscAsset &asset : assets)
+    {
+        if (asset.type == DISC_ASSET_MDEC)
+        {
+            mdec_count++;
+            printf("0x%010llx  sector %-7u mdec  %8zu bytes  %5zu macroblocks  q_scale %d\n",
+                   (unsigned long long)asset.file_offset, asset.sectors[0], asset.bytes, asset.macroblocks,
+                   asset.q_scale);
+        }
+        else
+            printf("0x%010llx  sector %-7u str   %8zu bytes  frame %u  %dx%d\n", (unsigned long long)asset.file_offset,
+                   asset.sectors[0], asset.bytes, asset.frame, asset.width, asset.height);
+    }
+    double mb = image.size() / (1024.0 * 1024.0);
+    printf("Found %zu MDEC streams and %zu STR frames in %.2f MB (%s image) in %.3f s: %.1f MB/s\n", mdec_count,
+           assets.size() - mdec_count, mb, image.raw() ? "raw 2352-byte sector" : "2048-byte sector", scan_seconds,
+           scan_seconds > 0 ? mb / scan_seconds : 0.0);
+
+    int status = 0;
+    if (out_dir && !assets.empty())
+    {
+        std::error_code ec;
+        fs::create_directories(out_dir, ec);
+
+        int thread_count = options.threads > 0 ? options.threads : (int)std::thread::hardware_concurrency();
+        thread_count = std::max(1, std::min(thread_count, (int)assets.size()));
+        std::atomic<size_t> next_asset{0};
+        std::atomic<size_t> failures{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thread_count; t++)
+        {
+            threads.emplace_back([&]()
+                                 {
+                std::vector<uint8_t> bytes;
+                for (size_t i = next_asset++; i < assets.size(); i = next_asset++)
+                {
+                    TraceScope trace("extract", (int64_t)i);
+                    read_disc_asset(image, assets[i], bytes);
+                    std::string path = (fs::path(out_dir) / asset_file_name(assets[i])).string();
+                    if (!write_bytes(path.c_str(), bytes))
+                    {
+                        std::cerr << "Error: cannot write " << path << std::endl;
+                        failures++;
+                    }
+                } });
+        }
+        for (std::thread &t : threads)
+            t.join();
+        printf("Extracted %zu/%zu assets to %s\n", assets.size() - failures, assets.size(), out_dir);
+        status = failures ? 1 : 0;
+    }
+
+    if (trace_path && !write_trace(trace_path))
+        status = 1;
+    return status;
+}
@@ -0,0 +1,136 @@
+#include "stats.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define MDEC_HAVE_RDTSC 1
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+static const char *stage_names[MDEC_STAGE_COUNT] = {"read", "rle", "idct", "color", "reassembly", "write"};
+
+void MdecStats::merge(const MdecStats &other)
+{
+    for (int i = 0; i < MDEC_STAGE_COUNT; i++)
+        stage_ticks[i] += other.stage_ticks[i];
+    files += other.files;
+    blocks += other.blocks;
+    dc_only_blocks += other.dc_only_blocks;
+    nonzero_coefficients += other.nonzero_coefficients;
+    padding_words += other.padding_words;
+    bytes_in += other.bytes_in;
+    bytes_out += other.bytes_out;
+}
+
+uint64_t mdec_stats_ticks()
+{
+#ifdef MDEC_HAVE_RDTSC
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+// Reference point taken at startup for calibrating the tick rate
+static const auto calibration_time = std::chrono::steady_clock::now();
+static const uint64_t calibration_ticks = mdec_stats_ticks();
+
+double mdec_stats_tick_rate()
+{
+#ifdef MDEC_HAVE_RDTSC
+    // Too short an interval gives a noisy rate
+    auto minimum = calibration_time + std::chrono::milliseconds(20);
+    if (std::chrono::steady_clock::now() < minimum)
+        std::this_thread::sleep_until(minimum);
+    uint64_t ticks = mdec_stats_ticks();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - calibration_time).count();
+    return (ticks - calibration_ticks) / seconds;
+#else
+    return 1e9;
+#endif
+}
+
+size_t peak_rss_bytes()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss; // bytes on macOS
+#else
+    return (size_t)usage.ru_maxrss * 1024; // kilobytes on Linux
+#endif
+#else
+    return 0;
+#endif
+}
+
+void print_stats(const MdecStats &stats, double wall_seconds)
+{
+#if MDEC_STATS
+    double rate = mdec_stats_tick_rate();
+    double total = 0.0;
+    for (uint64_t ticks : stats.stage_ticks)
+        total += ticks / rate;
+
+    // Stage times are summed over threads, so they can exceed the wall time of a batch
+    printf("Stage            time (ms)   share\n");
+    for (int i = 0; i < MDEC_STAGE_COUNT; i++)
+    {
+        double seconds = stats.stage_ticks[i] / rate;
+        printf("  %-12s %12.3f  %5.1f%%\n", stage_names[i], seconds * 1e3, total > 0 ? 100.0 * seconds / total : 0.0);
+    }
+    printf("  %-12s %12.3f  (wall %.3f)\n", "total", total * 1e3, wall_seconds * 1e3);
+    printf("Blocks: %llu (%llu DC-only, %.1f%%), %.2f nonzero AC per block, %llu padding words skipped\n",
+           (unsigned long long)stats.blocks, (unsigned long long)stats.dc_only_blocks,
+           stats.blocks ? 100.0 * stats.dc_only_blocks / stats.blocks : 0.0,
+           stats.blocks ? (double)stats.nonzero_coefficients / stats.blocks : 0.0,
+           (unsigned long long)stats.padding_words);
+    printf("Files: %llu, %.2f MB in, %.2f MB out, peak RSS %.1f MB\n", (unsigned long long)stats.files,
+           stats.bytes_in / 1e6, stats.bytes_out / 1e6, peak_rss_bytes() / 1e6);
+#else
+    (void)stats;
+    (void)wall_seconds;
+    printf("Statistics were compiled out (MDEC_STATS=0)\n");
+#endif
+}
+
+bool write_stats_json(const char *path, const MdecStats &stats, double wall_seconds)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        std::cerr << "Error: Could not open output file " << path << std::endl;
+        return false;
+    }
+
+    double rate = MDEC_STATS ? mdec_stats_tick_rate() : 1.0;
+    fprintf(out, "{\n  \"enabled\": %s,\n  \"wall_s\": %.6f,\n  \"stages_s\": {", MDEC_STATS ? "true" : "false",
+            wall_seconds);
+    for (int i = 0; i < MDEC_STAGE_COUNT; i++)
+        fprintf(out, "%s\"%s\": %.6f", i ? ", " : "", stage_names[i], stats.stage_ticks[i] / rate);
+    fprintf(out,
+            "},\n  \"files\": %llu,\n  \"blocks\": %llu,\n  \"dc_only_blocks\": %llu,\n"
+            "  \"nonzero_coefficients\": %llu,\n  \"padding_words\": %llu,\n  \"bytes_in\": %llu,\n"
+            "  \"bytes_out\": %llu,\n  \"peak_rss_bytes\": %zu\n}\n",
+            (unsigned long long)stats.files, (unsigned long long)stats.blocks,
+            (unsigned long long)stats.dc_only_blocks, (unsigned long long)stats.nonzero_coefficients,
+            (unsigned long long)stats.padding_words, (unsigned long long)stats.bytes_in,
+            (unsigned long long)stats.bytes_out, peak_rss_bytes());
+    fclose(out);
+    return true;
+}
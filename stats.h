@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Instrumentation behind --stats. Build with -DMDEC_STATS=0 (CMake option MDEC_STATS=OFF) to
+// compile every timer and counter out of the decoder; otherwise the cost when no MdecStats is
+// attached is one pointer test per block.
+#ifndef MDEC_STATS
+#define MDEC_STATS 1
+#endif
+
+enum MdecStage
+{
+    MDEC_STAGE_READ = 0,
+    MDEC_STAGE_RLE,
+    MDEC_STAGE_IDCT,
+    MDEC_STAGE_COLOR,
+    MDEC_STAGE_REASSEMBLY,
+    MDEC_STAGE_WRITE,
+    MDEC_STAGE_COUNT
+};
+
+// Per-thread totals; combine threads with merge()
+struct MdecStats
+{
+    uint64_t stage_ticks[MDEC_STAGE_COUNT] = {};
+    uint64_t files = 0;
+    uint64_t blocks = 0;
+    uint64_t dc_only_blocks = 0;
+    uint64_t nonzero_coefficients = 0; // AC levels, excluding DC
+    uint64_t padding_words = 0;        // 0xfe00 words skipped before a block header
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+
+    void merge(const MdecStats &other);
+};
+
+// Cycle counter (RDTSC on x86-64, steady_clock nanoseconds elsewhere)
+uint64_t mdec_stats_ticks();
+
+// Ticks per second, calibrated against steady_clock since program start
+double mdec_stats_tick_rate();
+
+// Peak resident set size of the process in bytes (0 if unknown)
+size_t peak_rss_bytes();
+
+void print_stats(const MdecStats &stats, double wall_seconds);
+bool write_stats_json(const char *path, const MdecStats &stats, double wall_seconds);
+
+#if MDEC_STATS
+// Adds the ticks spent in its scope to one stage, if stats is set
+class StageTimer
+{
+public:
+    StageTimer(MdecStats *stats, MdecStage stage)
+        : stats_(stats), stage_(stage), start_(stats ? mdec_stats_ticks() : 0) {}
+    ~StageTimer()
+    {
+        if (stats_)
+            stats_->stage_ticks[stage_] += mdec_stats_ticks() - start_;
+    }
+
+private:
+    MdecStats *stats_;
+    MdecStage stage_;
+    uint64_t start_;
+};
+
+#define MDEC_STAGE_TIMER(stats, stage) StageTimer mdec_stage_timer((stats), (stage))
+#define MDEC_STATS_ADD(stats, field, value) \
+    do                                      \
+    {                                       \
+        if (stats)                          \
+            (stats)->field += (value);      \
+    } while (0)
+#else
+// Unevaluated, but still uses the arguments so compiled-out builds stay warning-free
+#define MDEC_STAGE_TIMER(stats, stage) ((void)sizeof(stats), (void)sizeof(stage))
+#define MDEC_STATS_ADD(stats, field, value) ((void)sizeof((stats)->field), (void)sizeof(value))
+#endif
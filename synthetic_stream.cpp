@@ -0,0 +1,116 @@
+#include "synthetic_stream.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <sstream>
+
+bool parse_q_scale_distribution(const std::string &text, std::vector<std::pair<int, double>> &q_scales)
+{
+    q_scales.clear();
+    std::stringstream list(text);
+    std::string entry;
+    while (std::getline(list, entry, ','))
+    {
+        int q = 0;
+        double weight = 1.0;
+        size_t colon = entry.find(':');
+        try
+        {
+            q = std::stoi(entry.substr(0, colon));
+            if (colon != std::string::npos)
+                weight = std::stod(entry.substr(colon + 1));
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+        if (q < 1 || q > 63 || weight < 0.0)
+            return false;
+        q_scales.push_back({q, weight});
+    }
+    return !q_scales.empty();
+}
+
+SyntheticStreamGenerator::SyntheticStreamGenerator(const SyntheticStreamOptions &options)
+    : options_(options),
+      macroblocks_((size_t)((options.width + 15) / 16) * ((options.height + 15) / 16)),
+      state_(options.seed)
+{
+    options_.density = std::clamp(options_.density, 0.0, 63.0);
+    for (const auto &q : options_.q_scales)
+        q_total_weight_ += q.second;
+}
+
+// splitmix64
+uint64_t SyntheticStreamGenerator::next()
+{
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+uint32_t SyntheticStreamGenerator::uniform(uint32_t n)
+{
+    return (uint32_t)(((next() >> 32) * n) >> 32);
+}
+
+double SyntheticStreamGenerator::unit()
+{
+    return (next() >> 11) * 0x1p-53;
+}
+
+void SyntheticStreamGenerator::emit_block(int q_scale, std::vector<uint16_t> &words)
+{
+    // DC wanders between neighbouring blocks instead of jumping, like a real image
+    dc_ = std::clamp(dc_ + (int)uniform(65) - 32, -400, 400);
+    words.push_back((uint16_t)(q_scale << 10 | (dc_ & 0x3ff)));
+
+    int count = 0;
+    if (unit() >= options_.dc_only_fraction)
+    {
+        count = (int)options_.density;
+        if (unit() < options_.density - count)
+            count++;
+    }
+
+    // Partial Fisher-Yates picks count distinct positions from 1..63
+    uint8_t positions[63];
+    for (int k = 0; k < 63; k++)
+        positions[k] = (uint8_t)(k + 1);
+    for (int i = 0; i < count; i++)
+        std::swap(positions[i], positions[i + uniform(63 - i)]);
+    std::sort(positions, positions + count);
+
+    int k = 0;
+    for (int i = 0; i < count; i++)
+    {
+        // Magnitude 1, 2, 3, ... with probability halving each step (run of one bits), random sign
+        uint64_t bits = next();
+        int magnitude = 1 + std::countr_one(bits >> 1);
+        int level = (bits & 1) ? -magnitude : magnitude;
+        words.push_back((uint16_t)((positions[i] - k - 1) << 10 | (level & 0x3ff)));
+        k = positions[i];
+    }
+    // Also after coefficient 63, where the hardware still reads the end of block
+    words.push_back(0xfe00);
+}
+
+void SyntheticStreamGenerator::next_frame(std::vector<uint16_t> &words)
+{
+    int q_scale = options_.q_scales.empty() ? 1 : options_.q_scales.back().first;
+    double pick = unit() * q_total_weight_;
+    for (const auto &q : options_.q_scales)
+    {
+        if (pick < q.second)
+        {
+            q_scale = q.first;
+            break;
+        }
+        pick -= q.second;
+    }
+
+    for (size_t block = 0; block < macroblocks_ * 6; block++)
+        emit_block(q_scale, words);
+}
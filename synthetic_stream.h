@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Shape of a generated stream. Every frame is width x height; q_scale is drawn per frame from
+// q_scales (value, weight pairs), as in real FMV where one scale covers a whole frame.
+struct SyntheticStreamOptions
+{
+    int width = 320;
+    int height = 240;
+    double density = 8.0;          // mean nonzero AC levels per block that is not DC-only
+    double dc_only_fraction = 0.0; // share of blocks with no AC levels at all
+    std::vector<std::pair<int, double>> q_scales = {{1, 1.0}, {2, 1.0}, {4, 1.0}, {8, 1.0}, {16, 1.0}, {32, 1.0}};
+    uint64_t seed = 1;
+};
+
+// Parse "q:weight,q:weight,..." (a bare "q" has weight 1). Returns false on malformed input.
+bool parse_q_scale_distribution(const std::string &text, std::vector<std::pair<int, double>> &q_scales);
+
+// Deterministic generator of valid MDEC RLE streams. Uses its own PRNG and integer mappings
+// rather than <random> distributions, so a seed gives the same bytes on every platform.
+// Each block has floor(density) or ceil(density) AC levels (matching the mean) at uniformly
+// chosen zigzag positions, with small geometric magnitudes like real quantised data.
+class SyntheticStreamGenerator
+{
+public:
+    explicit SyntheticStreamGenerator(const SyntheticStreamOptions &options);
+
+    // Append one frame (all macroblocks, column-major like the decoder expects)
+    void next_frame(std::vector<uint16_t> &words);
+
+    size_t macroblocks_per_frame() const { return macroblocks_; }
+
+private:
+    uint64_t next();
+    uint32_t uniform(uint32_t n); // 0 .. n-1
+    double unit();                // [0, 1)
+    void emit_block(int q_scale, std::vector<uint16_t> &words);
+
+    SyntheticStreamOptions options_;
+    size_t macroblocks_;
+    uint64_t state_;
+    double q_total_weight_ = 0.0;
+    int dc_ = 0;
+};
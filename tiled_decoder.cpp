@@ -0,0 +1,125 @@
+#include "tiled_decoder.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "trace.h"
+
+TiledDecoder::TiledDecoder(const uint16_t *data, const uint16_t *end, int width, int height, int tile_macroblocks,
+                           size_t cache_bytes)
+    : end_(const_cast<uint16_t *>(end)), width_(width), height_(height), columns_((width + 15) / 16),
+      rows_((height + 15) / 16), tile_macroblocks_(std::max(1, tile_macroblocks))
+{
+    size_t tile_bytes = (size_t)tile_size() * tile_size() * 3;
+    max_tiles_ = std::max<size_t>(1, cache_bytes / tile_bytes);
+
+    // Only read: the decode functions take mutable pointers
+    TraceScope trace("index");
+    uint16_t *p = const_cast<uint16_t *>(data);
+    size_t count = (size_t)columns_ * rows_;
+    offsets_.reserve(count);
+    while (offsets_.size() < count)
+    {
+        uint16_t *start = p;
+        if (skip_mdec_macroblocks(&p, end_, 1) != 1)
+            break;
+        offsets_.push_back(start);
+    }
+}
+
+bool TiledDecoder::decode_macroblock(int mb_x, int mb_y, uint8_t *output, int output_width, int x, int y)
+{
+    size_t index = (size_t)mb_x * rows_ + mb_y;
+    if (index >= offsets_.size())
+        return false;
+    uint16_t *p = offsets_[index];
+    ctx_.early_terminate = false;
+    process_macroblock(ctx_, &p, output, end_, output_width, x, y);
+    macroblocks_decoded++;
+    return true;
+}
+
+void TiledDecoder::decode_tile(int tile_x, int tile_y, uint8_t *rgb)
+{
+    TraceScope trace("tile", (int64_t)tile_y * tiles_x() + tile_x);
+    int size = tile_size();
+    memset(rgb, 0, (size_t)size * size * 3);
+    int mb_x0 = tile_x * tile_macroblocks_;
+    int mb_y0 = tile_y * tile_macroblocks_;
+    int mb_x1 = std::min(columns_, mb_x0 + tile_macroblocks_);
+    int mb_y1 = std::min(rows_, mb_y0 + tile_macroblocks_);
+    // Columns are contiguous in the stream, so this walks the words in order
+    for (int mb_x = mb_x0; mb_x < mb_x1; mb_x++)
+        for (int mb_y = mb_y0; mb_y < mb_y1; mb_y++)
+            decode_macroblock(mb_x, mb_y, rgb, size, (mb_x - mb_x0) * 16, (mb_y - mb_y0) * 16);
+}
+
+const uint8_t *TiledDecoder::tile(int tile_x, int tile_y, int &width, int &height)
+{
+    if (tile_x < 0 || tile_y < 0 || tile_x >= tiles_x() || tile_y >= tiles_y())
+        return nullptr;
+    int size = tile_size();
+    width = std::min(size, width_ - tile_x * size);
+    height = std::min(size, height_ - tile_y * size);
+
+    uint32_t key = (uint32_t)tile_y * tiles_x() + tile_x;
+    auto found = tiles_.find(key);
+    if (found != tiles_.end())
+    {
+        tile_hits++;
+        lru_.splice(lru_.begin(), lru_, found->second);
+        return found->second->rgb.data();
+    }
+    tile_misses++;
+
+    // Reuse the least recently used tile's buffer once the cache is full
+    if (tiles_.size() >= max_tiles_)
+    {
+        tiles_.erase(lru_.back().key);
+        lru_.splice(lru_.begin(), lru_, std::prev(lru_.end()));
+    }
+    else
+        lru_.emplace_front();
+    Tile &entry = lru_.front();
+    entry.key = key;
+    entry.rgb.resize((size_t)size * size * 3);
+    decode_tile(tile_x, tile_y, entry.rgb.data());
+    tiles_[key] = lru_.begin();
+    return entry.rgb.data();
+}
+
+bool TiledDecoder::read_region(int x, int y, int width, int height, uint8_t *dst, size_t stride)
+{
+    int x1 = std::min(width_, x + width);
+    int y1 = std::min(height_, y + height);
+    if (x < 0 || y < 0 || x >= x1 || y >= y1)
+        return false;
+
+    int size = tile_size();
+    for (int tile_x = x / size; tile_x * size < x1; tile_x++)
+    {
+        for (int tile_y = y / size; tile_y * size < y1; tile_y++)
+        {
+            int tile_width, tile_height;
+            const uint8_t *rgb = tile(tile_x, tile_y, tile_width, tile_height);
+            // Overlap of the region and this tile, in image coordinates
+            int left = std::max(x, tile_x * size);
+            int right = std::min(x1, tile_x * size + tile_width);
+            int top = std::max(y, tile_y * size);
+            int bottom = std::min(y1, tile_y * size + tile_height);
+            for (int row = top; row < bottom; row++)
+                memcpy(dst + (row - y) * stride + (left - x) * 3,
+                       rgb + ((size_t)(row - tile_y * size) * size + (left - tile_x * size)) * 3, (right - left) * 3);
+        }
+    }
+    return true;
+}
+
+bool TiledDecoder::read_macroblock(int mb_x, int mb_y, uint8_t *rgb)
+{
+    if (mb_x < 0 || mb_y < 0 || mb_x >= columns_ || mb_y >= rows_)
+        return false;
+    memset(rgb, 0, 16 * 16 * 3);
+    decode_macroblock(mb_x, mb_y, rgb, 16, 0, 0);
+    return true;
+}
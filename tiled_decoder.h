@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "mdec.h"
+
+// Random access to the pixels of one large MDEC image, e.g. for panning a stitched background.
+// Construction walks the stream once with skip_mdec_block to record where every macroblock
+// starts, which costs no decoding. After that a tile only runs rle_decode, IDCT and colour
+// conversion for its own macroblocks, so the time to its first pixels depends on the tile size
+// and not on the image size. Decoded tiles are kept in a least recently used cache of bounded
+// size. Not thread-safe; the input words must outlive the decoder.
+class TiledDecoder
+{
+public:
+    // tile_macroblocks is the tile edge in macroblocks (4 = 64x64 pixels)
+    TiledDecoder(const uint16_t *data, const uint16_t *end, int width, int height, int tile_macroblocks = 4,
+                 size_t cache_bytes = 16u << 20);
+
+    // False if the stream ends before width x height; the missing macroblocks decode as black
+    bool complete() const { return offsets_.size() == (size_t)columns_ * rows_; }
+
+    int tile_size() const { return tile_macroblocks_ * 16; }
+    int tiles_x() const { return (columns_ + tile_macroblocks_ - 1) / tile_macroblocks_; }
+    int tiles_y() const { return (rows_ + tile_macroblocks_ - 1) / tile_macroblocks_; }
+
+    // RGB24 pixels of a tile, tile_size() * 3 bytes per row, clipped to the image at the right
+    // and bottom edges (width and height are set to the visible part). Valid until the next
+    // call. Null for tile coordinates outside the image.
+    const uint8_t *tile(int tile_x, int tile_y, int &width, int &height);
+
+    // Copy a pixel rectangle (clipped to the image) into dst, RGB24 rows stride bytes apart,
+    // decoding only the tiles it overlaps. Returns false if it lies outside the image.
+    bool read_region(int x, int y, int width, int height, uint8_t *dst, size_t stride);
+
+    // Decode one macroblock without going through the tile cache (16 * 16 * 3 bytes, packed)
+    bool read_macroblock(int mb_x, int mb_y, uint8_t *rgb);
+
+    MdecContext &context() { return ctx_; }
+
+    uint64_t tile_hits = 0;
+    uint64_t tile_misses = 0;
+    uint64_t macroblocks_decoded = 0;
+
+private:
+    struct Tile
+    {
+        uint32_t key;
+        std::vector<uint8_t> rgb;
+    };
+
+    void decode_tile(int tile_x, int tile_y, uint8_t *rgb);
+    bool decode_macroblock(int mb_x, int mb_y, uint8_t *output, int output_width, int x, int y);
+
+    uint16_t *end_;
+    int width_;
+    int height_;
+    int columns_;
+    int rows_;
+    int tile_macroblocks_;
+    size_t max_tiles_;
+    MdecContext ctx_;
+
+    // Start of each macroblock in stream (column-major) order
+    std::vector<uint16_t *> offsets_;
+
+    std::list<Tile> lru_; // most recently used first
+    std::unordered_map<uint32_t, std::list<Tile>::iterator> tiles_;
+};
@@ -0,0 +1,116 @@
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct TraceEvent
+{
+    const char *name;
+    uint64_t start;
+    uint64_t duration;
+    int64_t arg;
+};
+
+struct ThreadBuffer
+{
+    uint32_t tid = 0;
+    std::string name;
+    std::vector<TraceEvent> events;
+};
+
+std::atomic<bool> enabled{false};
+std::chrono::steady_clock::time_point origin;
+
+// Buffers outlive their threads so spans can be written after the workers exit
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+thread_local ThreadBuffer *local_buffer = nullptr;
+
+ThreadBuffer &thread_buffer()
+{
+    if (!local_buffer)
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(std::make_unique<ThreadBuffer>());
+        local_buffer = registry.back().get();
+        local_buffer->tid = (uint32_t)registry.size();
+        local_buffer->events.reserve(4096);
+    }
+    return *local_buffer;
+}
+} // namespace
+
+void trace_enable(bool on)
+{
+    if (on && !enabled.load())
+        origin = std::chrono::steady_clock::now();
+    enabled.store(on, std::memory_order_release);
+}
+
+bool trace_enabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t trace_now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin)
+        .count();
+}
+
+void trace_span(const char *name, uint64_t start, int64_t arg)
+{
+    if (!trace_enabled())
+        return;
+    uint64_t now = trace_now();
+    thread_buffer().events.push_back({name, start, now - start, arg});
+}
+
+void trace_thread_name(const char *name)
+{
+    if (trace_enabled())
+        thread_buffer().name = name;
+}
+
+bool write_trace(const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        std::cerr << "Error: Could not open output file " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    bool first = true;
+    for (const std::unique_ptr<ThreadBuffer> &buffer : registry)
+    {
+        std::string name = buffer->name.empty() ? (buffer->tid == 1 ? "main" : "thread " + std::to_string(buffer->tid))
+                                                : buffer->name;
+        fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+                first ? "" : ",\n", buffer->tid, name.c_str());
+        first = false;
+
+        for (const TraceEvent &e : buffer->events)
+        {
+            fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"mdec\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f",
+                    e.name, buffer->tid, e.start / 1e3, e.duration / 1e3);
+            if (e.arg >= 0)
+                fprintf(out, ", \"args\": {\"n\": %lld}", (long long)e.arg);
+            fprintf(out, "}");
+        }
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+// Optional span tracer that writes Chrome trace-event JSON (open in Perfetto or
+// chrome://tracing). Each thread appends to its own buffer with no locking; a thread takes a
+// lock only once, to register its buffer on the first span. When tracing is off, a span costs
+// a single relaxed atomic load.
+
+// Turn recording on or off (off by default)
+void trace_enable(bool enabled);
+bool trace_enabled();
+
+// Nanoseconds since tracing was enabled
+uint64_t trace_now();
+
+// Record a span [start, now) for the calling thread. name must be a string literal (only
+// the pointer is stored); arg is shown in the span's details, -1 for none.
+void trace_span(const char *name, uint64_t start, int64_t arg = -1);
+
+// Label the calling thread in the viewer (copied)
+void trace_thread_name(const char *name);
+
+// Write every recorded span. Call once worker threads have finished.
+bool write_trace(const char *path);
+
+// Records its lifetime as a span
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name, int64_t arg = -1)
+        : name_(name), arg_(arg), active_(trace_enabled()), start_(active_ ? trace_now() : 0) {}
+    ~TraceScope()
+    {
+        if (active_)
+            trace_span(name_, start_, arg_);
+    }
+
+private:
+    const char *name_;
+    int64_t arg_;
+    bool active_;
+    uint64_t start_;
+};
@@ -0,0 +1,715 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "command_stream.h"
+#include "image_writer.h"
+#include "kernels.h"
+#include "mdec.h"
+#include "synthetic_stream.h"
+
+// Accumulated differences between a kernel's output and the reference
+struct Comparison
+{
+    uint64_t samples = 0;
+    uint64_t mismatches = 0;
+    int max_error = 0;
+    double squared_error = 0.0;
+
+    void add(int reference, int value)
+    {
+        int error = std::abs(reference - value);
+        samples++;
+        if (error)
+        {
+            mismatches++;
+            max_error = std::max(max_error, error);
+            squared_error += (double)error * error;
+        }
+    }
+
+    double psnr() const
+    {
+        if (squared_error == 0.0)
+            return INFINITY;
+        return 10.0 * std::log10(255.0 * 255.0 * samples / squared_error);
+    }
+};
+
+static int failures = 0;
+
+// max_error < 0 skips the error check, min_psnr 0 the PSNR check
+static void report(const char *kernel, const std::string &input, const Comparison &c, int max_error,
+                   double min_psnr)
+{
+    bool ok = (max_error < 0 || c.max_error <= max_error) && c.psnr() >= min_psnr;
+    if (!ok)
+        failures++;
+    printf("%-18s %-26s %8d %12llu %12llu %9.2f  %s\n", kernel, input.c_str(), c.max_error,
+           (unsigned long long)c.mismatches, (unsigned long long)c.samples, c.psnr(), ok ? "ok" : "FAIL");
+}
+
+// xorshift64*, so the random inputs are the same on every platform
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+static uint32_t random_u32()
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545f4914f6cdd1dull) >> 32);
+}
+
+static void compare_idct(const IdctKernel &kernel, const int16_t coefficients[64], Comparison &c)
+{
+    int16_t expected[8][8], actual[8][8];
+    idct_reference(coefficients, expected);
+    kernel.idct(coefficients, actual);
+    for (int y = 0; y < 8; y++)
+        for (int x = 0; x < 8; x++)
+            c.add(expected[y][x], actual[y][x]);
+}
+
+// Every position alone at every value in +-2047, then sparse random blocks like real data
+static void verify_idct_blocks(const IdctKernel &kernel)
+{
+    Comparison single;
+    int16_t coefficients[64];
+    for (int position = 0; position < 64; position++)
+    {
+        for (int value = -2047; value <= 2047; value++)
+        {
+            memset(coefficients, 0, sizeof(coefficients));
+            coefficients[position] = (int16_t)value;
+            compare_idct(kernel, coefficients, single);
+        }
+    }
+    report(kernel.name, "exhaustive single coef", single, kernel.max_error, 0.0);
+
+    Comparison random;
+    rng_state = 0x9e3779b97f4a7c15ull;
+    for (int block = 0; block < 100000; block++)
+    {
+        memset(coefficients, 0, sizeof(coefficients));
+        coefficients[0] = (int16_t)((int)(random_u32() % 1024) - 512) * 2;
+        int count = random_u32() % 24;
+        for (int i = 0; i < count; i++)
+        {
+            // Low frequencies are larger, as after quantisation
+            int k = 1 + random_u32() % 63;
+            int limit = 1024 / (1 + k / 4);
+            coefficients[zagzig[k]] = (int16_t)((int)(random_u32() % (2 * limit + 1)) - limit);
+        }
+        compare_idct(kernel, coefficients, random);
+    }
+    report(kernel.name, "random sparse blocks", random, kernel.max_error, 0.0);
+}
+
+// Every Cb/Cr pair in the 9-bit range against a luma block sweeping the same range
+static void verify_color_exhaustive(const ColorKernel &kernel)
+{
+    int16_t y_block[8][8], cb_block[8][8], cr_block[8][8];
+    for (int i = 0; i < 64; i++)
+        y_block[i / 8][i % 8] = (int16_t)(i * 8 - 256);
+
+    Comparison c;
+    uint8_t expected[16 * 16 * 3], actual[16 * 16 * 3];
+    for (int cb = -256; cb < 256; cb++)
+    {
+        for (int cr = -256; cr < 256; cr++)
+        {
+            for (int i = 0; i < 64; i++)
+            {
+                cb_block[i / 8][i % 8] = (int16_t)cb;
+                cr_block[i / 8][i % 8] = (int16_t)cr;
+            }
+            yuv_to_rgb(y_block, cb_block, cr_block, 0, 0, 0, 0, expected, 16);
+            kernel.convert(y_block, cb_block, cr_block, 0, 0, 0, 0, actual, 16);
+            for (int y = 0; y < 8; y++)
+                for (int i = 0; i < 8 * 3; i++)
+                    c.add(expected[y * 48 + i], actual[y * 48 + i]);
+        }
+    }
+    report(kernel.name, "exhaustive 9-bit YCbCr", c, kernel.max_error, 0.0);
+}
+
+struct TestImage
+{
+    std::string name;
+    int width;
+    int height;
+    std::vector<uint16_t> words;
+    std::vector<uint8_t> reference; // decode_mdec_frame output
+};
+
+static const MdecBlockType block_types[6] = {MDEC_BLOCK_CR, MDEC_BLOCK_CB, MDEC_BLOCK_Y,
+                                             MDEC_BLOCK_Y, MDEC_BLOCK_Y, MDEC_BLOCK_Y};
+
+// The decode_mdec_frame pipeline with the IDCT and colour conversion swapped out
+static void decode_with(const TestImage &image, IdctFunction idct, ColorFunction convert, std::vector<uint8_t> &rgb)
+{
+    MdecContext ctx;
+    std::vector<uint16_t> words = image.words;
+    uint16_t *data = words.data();
+    uint16_t *end = data + words.size();
+    int rows = (image.height + 15) / 16;
+    rgb.assign((size_t)image.width * image.height * 3, 0);
+
+    for (size_t mb = 0; data < end; mb++)
+    {
+        int16_t blocks[6][8][8];
+        ctx.early_terminate = false;
+        for (int b = 0; b < 6; b++)
+        {
+            int16_t coefficients[64];
+            rle_decode(ctx, &data, coefficients, block_types[b], end, false);
+            idct(coefficients, blocks[b]);
+        }
+        if (ctx.early_terminate)
+            break;
+
+        uint8_t patch[16 * 16 * 3];
+        convert(blocks[2], blocks[1], blocks[0], 0, 0, 0, 0, patch, 16);
+        convert(blocks[3], blocks[1], blocks[0], 0, 0, 8, 0, patch, 16);
+        convert(blocks[4], blocks[1], blocks[0], 0, 0, 0, 8, patch, 16);
+        convert(blocks[5], blocks[1], blocks[0], 0, 0, 8, 8, patch, 16);
+
+        int px = (int)(mb / rows) * 16, py = (int)(mb % rows) * 16;
+        for (int y = 0; y < 16 && py + y < image.height; y++)
+            for (int x = 0; x < 16 && px + x < image.width; x++)
+                memcpy(&rgb[((size_t)(py + y) * image.width + px + x) * 3], &patch[(y * 16 + x) * 3], 3);
+    }
+}
+
+// The SSE2 RLE loop against the scalar one on the same words: every coefficient and the number
+// of words each block consumes must match, with and without prescaling
+static void verify_rle(const std::vector<uint16_t> &input, const std::string &name)
+{
+    // Slack after the end: like the hardware, both loops read the first AC word unchecked
+    std::vector<uint16_t> words = input;
+    words.push_back(0);
+    uint16_t *end = words.data() + input.size();
+    Comparison c;
+    for (int prescale = 0; prescale < 2; prescale++)
+    {
+        MdecContext simd_ctx, scalar_ctx;
+        scalar_ctx.scalar_rle = true;
+        uint16_t *simd = words.data();
+        uint16_t *scalar = words.data();
+        for (size_t b = 0; scalar < end; b++)
+        {
+            int16_t expected[64], actual[64];
+            rle_decode(scalar_ctx, &scalar, expected, block_types[b % 6], end, prescale != 0);
+            rle_decode(simd_ctx, &simd, actual, block_types[b % 6], end, prescale != 0);
+            for (int i = 0; i < 64; i++)
+                c.add(expected[i], actual[i]);
+            c.add((int)(scalar - words.data()), (int)(simd - words.data()));
+            if (scalar_ctx.early_terminate || simd != scalar)
+                break;
+        }
+    }
+    report("rle_decode sse2", name, c, 0, INFINITY);
+}
+
+// rle_decode with random quantisation tables (zeros included) against a word-by-word
+// dequantisation with quantize_dc and quantize_ac, through both RLE loops
+static void verify_quant_tables(const TestImage &image)
+{
+    uint8_t y[64], c[64];
+    for (int k = 0; k < 64; k++)
+    {
+        y[k] = (uint8_t)(random_u32() % 8 == 0 ? 0 : random_u32());
+        c[k] = (uint8_t)(random_u32() % 8 == 0 ? 0 : random_u32());
+    }
+    const MdecQuantTables *quant = mdec_quant_tables(y, c);
+
+    std::vector<uint16_t> words = image.words;
+    words.push_back(0);
+    uint16_t *end = words.data() + image.words.size();
+    Comparison result;
+    if (quant != mdec_quant_tables(y, c) || quant == mdec_default_quant_tables())
+        result.add(0, 1);
+    for (int scalar = 0; scalar < 2; scalar++)
+    {
+        MdecContext ctx;
+        ctx.quant = quant;
+        ctx.scalar_rle = scalar != 0;
+        uint16_t *data = words.data();
+        const uint16_t *p = data;
+        for (size_t b = 0; data < end; b++)
+        {
+            const uint8_t *qt = block_types[b % 6] == MDEC_BLOCK_Y ? y : c;
+            int16_t expected[64] = {0}, actual[64];
+            while (p < end && *p == 0xfe00)
+                p++;
+            if (p < end)
+            {
+                uint8_t q_scale = (*p >> 10) & 0x3f;
+                expected[zagzig[0]] = quantize_dc(*p++ & 0x3ff, qt[0]);
+                for (int k = 1; p <= end; k++)
+                {
+                    k += *p >> 10;
+                    if (k > 63)
+                    {
+                        p++;
+                        break;
+                    }
+                    expected[zagzig[k]] = quantize_ac(*p++ & 0x3ff, qt[k], q_scale);
+                    if (k == 63 || p >= end)
+                        break;
+                }
+            }
+            rle_decode(ctx, &data, actual, block_types[b % 6], end, false);
+            if (ctx.early_terminate)
+                break;
+            for (int i = 0; i < 64; i++)
+                result.add(expected[i], actual[i]);
+            result.add((int)(p - words.data()), (int)(data - words.data()));
+            if (data != p)
+                break;
+        }
+    }
+    report("quant tables", image.name, result, 0, INFINITY);
+
+    // Switching tables on a context with both macroblock reuse paths must not serve pixels
+    // decoded under the old ones
+    std::vector<uint8_t> expected((size_t)image.width * image.height * 3), actual(expected.size());
+    MdecContext fresh, reused;
+    fresh.quant = quant;
+    reused.macroblock_cache = std::make_unique<MacroblockCache>();
+    reused.reuse_previous_frame = true;
+    uint16_t *data = words.data();
+    decode_mdec_frame(fresh, &data, end, image.width, image.height, expected.data());
+    data = words.data();
+    decode_mdec_frame(reused, &data, end, image.width, image.height, actual.data());
+    reused.quant = quant;
+    data = words.data();
+    decode_mdec_frame(reused, &data, end, image.width, image.height, actual.data());
+    Comparison switched;
+    for (size_t i = 0; i < expected.size(); i++)
+        switched.add(expected[i], actual[i]);
+    report("quant switch", image.name, switched, 0, INFINITY);
+}
+
+// A command stream built from two images: settings must reach the right decode commands and
+// each image must match decoding its words directly with those settings
+static void verify_command_stream(const TestImage &first, const TestImage &second)
+{
+    uint8_t y[64], c[64];
+    for (int k = 0; k < 64; k++)
+    {
+        y[k] = (uint8_t)(1 + random_u32() % 64);
+        c[k] = (uint8_t)(1 + random_u32() % 64);
+    }
+    std::vector<uint16_t> stream;
+    auto command = [&](uint32_t word) {
+        stream.push_back((uint16_t)word);
+        stream.push_back((uint16_t)(word >> 16));
+    };
+    auto bytes = [&](const uint8_t *table) {
+        for (int k = 0; k < 64; k += 2)
+            stream.push_back((uint16_t)(table[k] | table[k + 1] << 8));
+    };
+    auto decode = [&](uint32_t depth, const TestImage &image) {
+        std::vector<uint16_t> words = image.words;
+        if (words.size() % 2)
+            words.push_back(0xfe00);
+        command(0x20000000 | depth << 27 | (uint32_t)(words.size() / 2));
+        stream.insert(stream.end(), words.begin(), words.end());
+    };
+    command(0x40000000 | MDEC_SET_QUANT_COLOR);
+    bytes(y);
+    bytes(c);
+    decode(MDEC_DEPTH_24BIT, first);
+    command(0x60000000);
+    stream.insert(stream.end(), scale_table.begin(), scale_table.end());
+    decode(MDEC_DEPTH_15BIT, first);
+    command(0x0000ffff); // does nothing; the low bits are not a parameter count
+    command(0x40000000);
+    bytes(c);
+    decode(MDEC_DEPTH_24BIT, second);
+    decode(MDEC_DEPTH_24BIT, second);
+    stream.resize(stream.size() - second.words.size() / 2);
+
+    MdecCommandStream parsed;
+    parse_mdec_command_stream(stream.data(), stream.size(), mdec_default_quant_tables(), parsed);
+    const MdecQuantTables *expected_quant[] = {mdec_quant_tables(y, c), mdec_quant_tables(y, c),
+                                               mdec_quant_tables(c, c), mdec_quant_tables(c, c)};
+    const TestImage *sources[] = {&first, &first, &second, &second};
+    Comparison result;
+    result.add(4, (int)parsed.images.size());
+    result.add(1, parsed.truncated);
+    result.add(2, (int)parsed.quant_commands);
+    result.add(1, (int)parsed.scale_commands);
+    result.add(1, (int)parsed.other_commands);
+    for (size_t i = 0; i < parsed.images.size() && i < 4; i++)
+    {
+        const MdecCommandImage &image = parsed.images[i];
+        const TestImage &source = *sources[i];
+        result.add(0, image.quant != expected_quant[i] || image.custom_scale);
+        result.add(i == 1 ? MDEC_DEPTH_15BIT : MDEC_DEPTH_24BIT, image.depth);
+
+        std::vector<uint8_t> expected((size_t)source.width * source.height * 3, 0), actual(expected.size());
+        MdecContext direct, ctx;
+        direct.quant = expected_quant[i];
+        std::vector<uint16_t> words(image.words, image.words + image.word_count);
+        uint16_t *data = words.data();
+        decode_mdec_frame(direct, &data, data + words.size(), source.width, source.height, expected.data());
+        if (image.depth == MDEC_DEPTH_15BIT)
+            for (uint8_t &value : expected)
+                value = (uint8_t)((value & 0xf8) | value >> 5);
+        decode_mdec_command_image(ctx, image, source.width, source.height, actual.data());
+        for (size_t p = 0; p < expected.size(); p++)
+            result.add(expected[p], actual[p]);
+    }
+    report("command stream", first.name, result, 0, INFINITY);
+}
+
+// Previous-frame reuse against plain decoding when only the previous frame's words stay valid:
+// a frame's buffer is overwritten once the next one has been decoded, and a truncated frame
+// sits between two complete ones
+static void verify_previous_frame(const TestImage &image)
+{
+    MdecContext ctx;
+    ctx.reuse_previous_frame = true;
+    std::vector<uint8_t> rgb((size_t)image.width * image.height * 3);
+    auto decode = [&](std::vector<uint16_t> &words, size_t count) {
+        std::fill(rgb.begin(), rgb.end(), 0);
+        uint16_t *data = words.data();
+        decode_mdec_frame(ctx, &data, data + count, image.width, image.height, rgb.data());
+    };
+    auto expect = [&](const std::vector<uint16_t> &words, Comparison &c) {
+        std::vector<uint8_t> expected(rgb.size(), 0);
+        std::vector<uint16_t> copy = words;
+        MdecContext plain;
+        uint16_t *data = copy.data();
+        decode_mdec_frame(plain, &data, data + copy.size(), image.width, image.height, expected.data());
+        for (size_t i = 0; i < rgb.size(); i++)
+            c.add(expected[i], rgb[i]);
+    };
+
+    // Same-size content that differs from image, padded so it fits in image's buffers
+    SyntheticStreamOptions options;
+    options.width = image.width;
+    options.height = image.height;
+    std::vector<uint16_t> second;
+    SyntheticStreamGenerator(options).next_frame(second);
+    second.resize(std::max(second.size(), image.words.size()), 0xfe00);
+    std::vector<uint16_t> first = image.words, repeat = image.words, third = second;
+    first.resize(second.size(), 0xfe00);
+    repeat.resize(second.size(), 0xfe00);
+
+    Comparison reused;
+    decode(first, image.words.size());
+    decode(repeat, image.words.size());
+    first = second; // freed and reused by the caller
+    decode(third, third.size());
+    expect(second, reused);
+    report("previous frame", "reused buffer", reused, 0, INFINITY);
+
+    Comparison truncated;
+    std::vector<uint16_t> full = image.words, cut = image.words, again = image.words;
+    decode(full, full.size());
+    decode(cut, cut.size() / 2);
+    decode(again, again.size());
+    expect(image.words, truncated);
+    report("previous frame", "truncated frame", truncated, 0, INFINITY);
+}
+
+// Decode a QOI file as the specification's reference decoder does, into RGB24. False if the
+// header or the end marker is wrong.
+static bool decode_qoi(const std::vector<uint8_t> &file, int width, int height, std::vector<uint8_t> &rgb)
+{
+    const uint8_t end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    if (file.size() < 22 || memcmp(file.data(), "qoif", 4) != 0 ||
+        memcmp(file.data() + file.size() - 8, end_marker, 8) != 0)
+        return false;
+    uint32_t w = (uint32_t)file[4] << 24 | file[5] << 16 | file[6] << 8 | file[7];
+    uint32_t h = (uint32_t)file[8] << 24 | file[9] << 16 | file[10] << 8 | file[11];
+    if (w != (uint32_t)width || h != (uint32_t)height)
+        return false;
+
+    uint8_t index[64][4] = {};
+    uint8_t px[4] = {0, 0, 0, 255};
+    size_t p = 14, chunks_end = file.size() - 8;
+    int run = 0;
+    rgb.assign((size_t)width * height * 3, 0);
+    for (size_t i = 0; i < (size_t)width * height; i++)
+    {
+        if (run > 0)
+            run--;
+        else if (p < chunks_end)
+        {
+            uint8_t op = file[p++];
+            if (op == 0xfe && p + 3 <= chunks_end)
+            {
+                memcpy(px, &file[p], 3);
+                p += 3;
+            }
+            else if (op == 0xff && p + 4 <= chunks_end)
+            {
+                memcpy(px, &file[p], 4);
+                p += 4;
+            }
+            else if ((op & 0xc0) == 0x00)
+                memcpy(px, index[op], 4);
+            else if ((op & 0xc0) == 0x40)
+            {
+                px[0] += ((op >> 4) & 3) - 2;
+                px[1] += ((op >> 2) & 3) - 2;
+                px[2] += (op & 3) - 2;
+            }
+            else if ((op & 0xc0) == 0x80 && p < chunks_end)
+            {
+                int vg = (op & 0x3f) - 32;
+                uint8_t b = file[p++];
+                px[0] += vg - 8 + (b >> 4);
+                px[1] += vg;
+                px[2] += vg - 8 + (b & 0x0f);
+            }
+            else if ((op & 0xc0) == 0xc0)
+                run = op & 0x3f;
+            else
+                return false;
+            memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+        }
+        if (px[3] != 255)
+            return false;
+        memcpy(&rgb[i * 3], px, 3);
+    }
+    return true;
+}
+
+// write_qoi through a specification decoder, on a decoded image and on black after colour,
+// which must not hit the decoder's zeroed (transparent) index slot
+static void verify_qoi(const TestImage &image)
+{
+    std::vector<uint8_t> pattern;
+    const uint8_t colours[][3] = {{200, 40, 30}, {0, 0, 0}, {0, 0, 0}, {90, 90, 90}, {0, 0, 0}, {200, 40, 30}};
+    for (int i = 0; i < 16 * 8; i++)
+        pattern.insert(pattern.end(), colours[i % 6], colours[i % 6] + 3);
+
+    std::string path = (std::filesystem::temp_directory_path() / "mdec_verify.qoi").string();
+    struct Input
+    {
+        std::string name;
+        int width, height;
+        const std::vector<uint8_t> *rgb;
+    } inputs[] = {{image.name, image.width, image.height, &image.reference}, {"black after colour", 16, 8, &pattern}};
+    for (const Input &input : inputs)
+    {
+        Comparison c;
+        std::vector<uint8_t> decoded;
+        bool ok = write_qoi(path.c_str(), input.width, input.height, input.rgb->data());
+        std::ifstream file(path, std::ios::binary);
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!ok || !decode_qoi(bytes, input.width, input.height, decoded))
+            c.add(0, 1);
+        else
+            for (size_t i = 0; i < decoded.size(); i++)
+                c.add((*input.rgb)[i], decoded[i]);
+        report("qoi writer", input.name, c, 0, INFINITY);
+    }
+    std::filesystem::remove(path);
+}
+
+// The compile-time tables against the same definitions evaluated with the runtime maths library
+static void verify_tables()
+{
+    // Zigzag: by anti-diagonal, rows ascending on odd diagonals and descending on even ones
+    std::vector<int> order(64);
+    for (int i = 0; i < 64; i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [](int a, int b) {
+        int da = a / 8 + a % 8, db = b / 8 + b % 8;
+        if (da != db)
+            return da < db;
+        return da % 2 ? a / 8 < b / 8 : a / 8 > b / 8;
+    });
+    Comparison zig;
+    for (int k = 0; k < 64; k++)
+    {
+        zig.add(order[k], zagzig[k]);
+        zig.add(k, zigzag[order[k]]);
+    }
+    report("tables", "zagzig, zigzag", zig, 0, INFINITY);
+
+    double sf[8];
+    Comparison factors;
+    for (int i = 0; i < 8; i++)
+    {
+        sf[i] = i == 0 ? 1.0 : std::round(std::sqrt(2.0) * std::cos(i * M_PI / 16) * 1e9) / 1e9;
+        factors.add(0, sf[i] != scalefactor[i]);
+    }
+    report("tables", "scalefactor", factors, 0, INFINITY);
+
+    Comparison prescale, basis;
+    for (int i = 0; i < 64; i++)
+    {
+        int row = i / 8, col = i % 8;
+        double exact = sf[row] * sf[col] / 8;
+        double digits = std::pow(10.0, 5 - std::floor(std::log10(exact)));
+        double expected = std::round(exact * digits) / digits;
+        prescale.add(0, expected != scalezag[zigzag[i]] || expected != scalezag_natural[i]);
+        prescale.add(0, (uint32_t)std::llround(expected * 4294967296.0) != scalezag_natural_fixed[i]);
+
+        double c = row == 0 ? 1 / std::sqrt(2.0) : 1.0;
+        int16_t value = (int16_t)std::floor(32768 * c * std::cos((2 * col + 1) * row * M_PI / 16));
+        basis.add(value, scale_table[i]);
+        basis.add(value / 8, scale_table_transposed[col * 8 + row]);
+    }
+    report("tables", "scalezag", prescale, 0, INFINITY);
+    report("tables", "scale_table", basis, 0, INFINITY);
+}
+
+// Every fixed-resolution reassembly against the generic loop, for complete and truncated
+// frames, with a stride wider than the row
+static void verify_fixed_pipelines()
+{
+    const int sizes[][2] = {{256, 192}, {320, 224}, {320, 240}, {640, 480}};
+    const char *formats[] = {"rgb24", "bgr24", "rgba32", "bgra32"};
+    for (const auto &size : sizes)
+    {
+        SyntheticStreamOptions options;
+        options.width = size[0];
+        options.height = size[1];
+        options.seed = size[0] * size[1];
+        std::vector<uint16_t> words;
+        SyntheticStreamGenerator(options).next_frame(words);
+        for (int f = 0; f < 4; f++)
+        {
+            MdecPixelFormat format = (MdecPixelFormat)f;
+            std::string name = std::to_string(size[0]) + "x" + std::to_string(size[1]) + " " + formats[f];
+            Comparison c;
+            if (!mdec_has_fixed_pipeline(size[0], size[1], format))
+                c.add(0, 1);
+            size_t stride = (size_t)size[0] * mdec_pixel_size(format) + 12;
+            for (size_t length : {words.size(), words.size() / 3})
+            {
+                std::vector<uint8_t> expected(stride * size[1], 0), actual(stride * size[1], 0);
+                MdecContext generic_ctx, fixed_ctx;
+                generic_ctx.generic_reassembly = true;
+                uint16_t *data = words.data();
+                decode_mdec_frame(generic_ctx, &data, words.data() + length, size[0], size[1], expected.data(),
+                                  stride, format);
+                data = words.data();
+                decode_mdec_frame(fixed_ctx, &data, words.data() + length, size[0], size[1], actual.data(), stride,
+                                  format);
+                for (size_t i = 0; i < expected.size(); i++)
+                    c.add(expected[i], actual[i]);
+            }
+            report("fixed pipeline", name, c, 0, INFINITY);
+        }
+    }
+}
+
+static void verify_image(const TestImage &image, const char *name, IdctFunction idct, ColorFunction convert,
+                         double min_psnr, int max_error = -1)
+{
+    std::vector<uint8_t> rgb;
+    decode_with(image, idct, convert, rgb);
+    Comparison c;
+    for (size_t i = 0; i < rgb.size(); i++)
+        c.add(image.reference[i], rgb[i]);
+    report(name, image.name, c, max_error, min_psnr);
+}
+
+// Checks every kernel variant against the reference decoder. Exits non-zero if any kernel
+// exceeds its error budget, or if the harness's own pipeline stops matching decode_mdec_frame.
+int main(int argc, char *argv[])
+{
+    std::vector<TestImage> images;
+    if (argc > 1)
+    {
+        TestImage example{"hod_loading.bin", 256, 192, {}, {}};
+        if (!read_mdec_file(argv[1], example.words))
+        {
+            std::cerr << "Error: Could not read input file " << argv[1] << std::endl;
+            return 1;
+        }
+        images.push_back(std::move(example));
+    }
+
+    const double densities[] = {2.0, 8.0, 24.0};
+    for (int i = 0; i < 3; i++)
+    {
+        SyntheticStreamOptions options;
+        options.width = 320;
+        options.height = 240;
+        options.density = densities[i];
+        options.dc_only_fraction = 0.3;
+        options.seed = i + 1;
+        TestImage image{"synthetic 320x240 ac" + std::to_string((int)densities[i]), 320, 240, {}, {}};
+        SyntheticStreamGenerator(options).next_frame(image.words);
+        images.push_back(std::move(image));
+    }
+
+    for (TestImage &image : images)
+    {
+        MdecContext ctx;
+        std::vector<uint16_t> words = image.words;
+        uint16_t *data = words.data();
+        image.reference.assign((size_t)image.width * image.height * 3, 0);
+        decode_mdec_frame(ctx, &data, data + words.size(), image.width, image.height, image.reference.data());
+    }
+
+    printf("%-18s %-26s %8s %12s %12s %9s\n", "kernel", "input", "max err", "mismatches", "samples", "PSNR");
+
+    verify_tables();
+
+    // The reference kernels through the harness pipeline must reproduce decode_mdec_frame exactly
+    for (const TestImage &image : images)
+        verify_image(image, "harness pipeline", idct_kernels[0].idct, color_kernels[0].convert, 0.0, 0);
+
+    for (const TestImage &image : images)
+        verify_rle(image.words, image.name);
+
+    verify_fixed_pipelines();
+    verify_previous_frame(images[0]);
+
+    for (const TestImage &image : images)
+        verify_quant_tables(image);
+    verify_command_stream(images[0], images.back());
+    verify_qoi(images[0]);
+
+    // Arbitrary words: long runs, early 0xfe00, blocks cut off by the end of the data
+    std::vector<uint16_t> noise(1 << 16);
+    for (uint16_t &word : noise)
+    {
+        uint32_t r = random_u32();
+        word = (r & 3) == 0 ? 0xfe00 : (uint16_t)((r >> 2) & ((r & 0x100) ? 0x0fff : 0xffff));
+    }
+    for (size_t length : {(size_t)1, (size_t)7, (size_t)9, (size_t)15, noise.size()})
+        verify_rle(std::vector<uint16_t>(noise.begin(), noise.begin() + length), "random words " + std::to_string(length));
+
+    for (size_t i = 1; i < idct_kernel_count; i++)
+    {
+        const IdctKernel &kernel = idct_kernels[i];
+        verify_idct_blocks(kernel);
+        for (const TestImage &image : images)
+            verify_image(image, kernel.name, kernel.idct, color_kernels[0].convert, kernel.min_psnr);
+    }
+
+    for (size_t i = 1; i < color_kernel_count; i++)
+    {
+        const ColorKernel &kernel = color_kernels[i];
+        verify_color_exhaustive(kernel);
+        for (const TestImage &image : images)
+            verify_image(image, kernel.name, idct_kernels[0].idct, kernel.convert, kernel.min_psnr);
+    }
+
+    if (failures)
+    {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All kernels within tolerance\n");
+    return 0;
+}